@@ -0,0 +1,94 @@
+#ifndef ANYDATAFRAME_H
+#define ANYDATAFRAME_H
+
+#include <memory>
+#include <variant>
+#include <QString>
+#include <QMetaType>
+#include "tfs_dataframe.h"
+
+/**
+ * @brief A shared, immutable snapshot of a dataframe in either full (`double`) or reduced (`float`) precision.
+ *
+ * The precision is chosen when a file is opened. Code that needs the concrete dataframe
+ * uses `visit` with a generic lambda, everything else goes through the convenience functions.
+ *
+ * Copies share the same dataframe, which lives as long as any copy does. The models, the filter
+ * worker and background jobs each keep their own copy, so opening another file never pulls the
+ * data out from under a running thread.
+ */
+class AnyDataframe
+{
+public:
+    template<typename real>
+    using pointer = std::shared_ptr<const tfs::dataframe<real>>;
+
+    AnyDataframe() : df(pointer<double>()) {}
+    AnyDataframe(pointer<double> dataframe) : df(std::move(dataframe)) {}
+    AnyDataframe(pointer<float> dataframe) : df(std::move(dataframe)) {}
+
+    bool is_null() const {
+        return std::visit([](auto& p) { return p == nullptr; }, df);
+    }
+
+    bool is_reduced_precision() const {
+        return std::holds_alternative<pointer<float>>(df);
+    }
+
+    /**
+     * @brief Calls `fn` with the dataframe (`const tfs::dataframe<double>&` or `const tfs::dataframe<float>&`).
+     * Must not be called if `is_null()`.
+     */
+    template<typename F>
+    decltype(auto) visit(F&& fn) const {
+        return std::visit([&](auto& p) -> decltype(auto) { return fn(*p); }, df);
+    }
+
+    size_t size() const {
+        return is_null() ? 0 : visit([](auto& d) { return d.size(); });
+    }
+
+    size_t column_count() const {
+        return is_null() ? 0 : visit([](auto& d) { return d.column_count(); });
+    }
+
+    size_t property_count() const {
+        return is_null() ? 0 : visit([](auto& d) { return d.property_count(); });
+    }
+
+    QString column_name(size_t column) const {
+        return visit([=](auto& d) { return QString::fromStdString(d.get_column(column).get_name()); });
+    }
+
+    tfs::DataType column_type(size_t column) const {
+        return visit([=](auto& d) { return d.get_column(column).get_type(); });
+    }
+
+    tfs::memory_footprint memory_usage() const {
+        if (is_null()) return tfs::memory_footprint();
+        return visit([](auto& d) { return d.memory_usage(); });
+    }
+
+    /**
+     * @brief Calls `fn` with the shared pointer to the dataframe
+     * (`AnyDataframe::pointer<double>` or `AnyDataframe::pointer<float>`).
+     */
+    template<typename F>
+    decltype(auto) visit_shared(F&& fn) const {
+        return std::visit([&](auto& p) -> decltype(auto) { return fn(p); }, df);
+    }
+
+    /**
+     * @brief Drops this reference, the dataframe is deleted once no other copy refers to it.
+     */
+    void reset() {
+        df = pointer<double>();
+    }
+
+private:
+    std::variant<pointer<double>, pointer<float>> df;
+};
+
+Q_DECLARE_METATYPE(AnyDataframe)
+
+#endif // ANYDATAFRAME_H
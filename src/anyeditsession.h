@@ -0,0 +1,64 @@
+#ifndef ANYEDITSESSION_H
+#define ANYEDITSESSION_H
+
+#include <memory>
+#include <variant>
+#include "anydataframe.h"
+#include "tfs_edit.h"
+
+/**
+ * @brief The edits of a dataframe in either full (`double`) or reduced (`float`) precision.
+ *
+ * Copies share the same session. Lives in the GUI thread, other threads get `snapshot`s.
+ */
+class AnyEditSession
+{
+public:
+    template<typename real>
+    using pointer = std::shared_ptr<tfs::edit_session<real>>;
+
+    AnyEditSession() : session(pointer<double>()) {}
+
+    /**
+     * @brief Starts editing `df`, which itself is never changed
+     */
+    explicit AnyEditSession(const AnyDataframe& df)
+        : session(df.visit_shared([](auto& p) -> std::variant<pointer<double>, pointer<float>> {
+              using real = typename std::decay_t<decltype(*p)>::value_type;
+              return std::make_shared<tfs::edit_session<real>>(p);
+          })) {}
+
+    bool is_null() const {
+        return std::visit([](auto& p) { return p == nullptr; }, session);
+    }
+
+    /**
+     * @brief Calls `fn` with the session (`tfs::edit_session<double>&` or `tfs::edit_session<float>&`).
+     * Must not be called if `is_null()`.
+     */
+    template<typename F>
+    decltype(auto) visit(F&& fn) const {
+        return std::visit([&](auto& p) -> decltype(auto) { return fn(*p); }, session);
+    }
+
+    /**
+     * @brief The current state, including all edits
+     */
+    AnyDataframe snapshot() const {
+        if (is_null()) return AnyDataframe();
+        return visit([](auto& s) { return AnyDataframe(s.snapshot()); });
+    }
+
+    bool can_undo() const { return !is_null() && visit([](auto& s) { return s.can_undo(); }); }
+    bool can_redo() const { return !is_null() && visit([](auto& s) { return s.can_redo(); }); }
+
+    tfs::memory_footprint memory_usage() const {
+        if (is_null()) return tfs::memory_footprint();
+        return visit([](auto& s) { return s.memory_usage(); });
+    }
+
+private:
+    std::variant<pointer<double>, pointer<float>> session;
+};
+
+#endif // ANYEDITSESSION_H
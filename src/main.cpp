@@ -7,14 +7,20 @@ int main(int argc, char *argv[])
 {
     QCommandLineParser parser;
     parser.addPositionalArgument("file", "tfs file to open");
+    QCommandLineOption reducedPrecision(QStringList() << "r" << "reduced-precision",
+                                        "load numbers in single precision (float32)");
+    parser.addOption(reducedPrecision);
 
     qInstallMessageHandler(Viewer::redirectMessageToLogWindow);
     qDebug() << "starting application";
 
     //QApplication::setStyle(new DarkStyle);
     QApplication a(argc, argv);
+    QApplication::setOrganizationName("qtfsviewer");
+    QApplication::setApplicationName("qtfsviewer");
     parser.process(a);
     Viewer w;
+    w.set_reduced_precision(parser.isSet(reducedPrecision));
     const auto args = parser.positionalArguments();
     if (args.count() > 0)
         w.open_tfs(args[0]);
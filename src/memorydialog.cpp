@@ -0,0 +1,65 @@
+#include "memorydialog.h"
+
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QVBoxLayout>
+#include <QDialogButtonBox>
+#include <QLocale>
+
+MemoryDialog::MemoryDialog(const AnyDataframe &df, QWidget *parent)
+    : QDialog(parent)
+{
+    setWindowTitle(tr("Memory Usage"));
+
+    auto table = new QTableWidget(this);
+    table->setColumnCount(6);
+    table->setHorizontalHeaderLabels({tr("Name"), tr("Type"), tr("Payload"), tr("Strings"), tr("Index"), tr("Total")});
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->verticalHeader()->hide();
+
+    auto add_row = [&](const QString& name, const QString& type, const tfs::memory_footprint& m) {
+        const int row = table->rowCount();
+        table->insertRow(row);
+        const size_t values[] = {m.payload, m.strings, m.index, m.total()};
+        table->setItem(row, 0, new QTableWidgetItem(name));
+        table->setItem(row, 1, new QTableWidgetItem(type));
+        for (int i = 0; i < 4; i++) {
+            auto item = new QTableWidgetItem(format_size(values[i]));
+            item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            table->setItem(row, 2 + i, item);
+        }
+    };
+
+    if (!df.is_null()) {
+        df.visit([&](auto& dataframe) {
+            tfs::memory_footprint columns;
+            for (size_t i = 0; i < dataframe.column_count(); i++) {
+                auto& column = dataframe.get_column(i);
+                auto m = dataframe.column_memory_usage(i);
+                columns += m;
+                add_row(QString::fromStdString(column.get_name()),
+                        QString(tfs::string_fromDT(column.get_type())), m);
+            }
+            // the rest: properties and lookup indices of the dataframe
+            auto total = dataframe.memory_usage();
+            tfs::memory_footprint other;
+            other.index = total.total() - columns.total();
+            add_row(tr("(properties, indices)"), QString(), other);
+            add_row(tr("Total"), QString(), total);
+        });
+    }
+    table->resizeColumnsToContents();
+
+    auto buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    auto layout = new QVBoxLayout(this);
+    layout->addWidget(table);
+    layout->addWidget(buttons);
+    resize(560, 400);
+}
+
+QString MemoryDialog::format_size(size_t bytes)
+{
+    return QLocale().formattedDataSize(static_cast<qint64>(bytes));
+}
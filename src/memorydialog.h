@@ -0,0 +1,22 @@
+#ifndef MEMORYDIALOG_H
+#define MEMORYDIALOG_H
+
+#include <QDialog>
+#include "anydataframe.h"
+
+/**
+ * @brief Lists the memory taken by each column of a dataframe (see `tfs::data_vector::memory_usage`)
+ */
+class MemoryDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    MemoryDialog(const AnyDataframe& df, QWidget* parent = nullptr);
+
+    /**
+     * @brief `bytes` in a human readable unit (KiB, MiB, ...)
+     */
+    static QString format_size(size_t bytes);
+};
+
+#endif // MEMORYDIALOG_H
@@ -1,41 +1,486 @@
 #include "qfilterworker.h"
 #include <QDebug>
+#include <QRegularExpression>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+#include <numeric>
+#include <cstring>
+#include <mutex>
 
-void QFilterWorker::filter(const QString& pattern, std::vector<size_t> *buf)
+namespace {
+/**
+ * @brief Copies `cell` into `subject` without reallocating (once `subject` is big enough).
+ * Cells are taken as Latin-1, which covers the ASCII names in TFS files.
+ */
+void to_subject(std::string_view cell, QString& subject)
 {
-    try {
-        std::smatch filtermatch;
-        std::regex regex(pattern.toStdString());
-        std::vector<size_t> string_columns;
-        for (size_t c = 0; c < df->column_count(); c++)
+    subject.resize(static_cast<int>(cell.size()));
+    QChar* out = subject.data();
+    for (char c : cell)
+        *out++ = QLatin1Char(c);
+}
+}
+
+void QFilterWorker::filter(const FilterRequest& request, quint64 generation)
+{
+    // superseded while waiting in the queue
+    if (is_stale(generation))
+        return;
+
+    const QString& pattern = request.pattern;
+    const AnyDataframe& df = request.df;
+    rows_t candidates = request.candidates;
+    const index_t& index = request.index;
+    update_column_cache(df);
+
+    if (request.mode == FilterMode::Fuzzy) {
+        filter_fuzzy(request, generation);
+        return;
+    }
+
+    if (request.query) {
+        rows_t rows;
+        try {
+            rows = std::make_shared<const tfs::row_set>(df.visit([&](auto& dataframe) {
+                auto match_strings = [this](auto& column, const std::string& regex) {
+                    // null cells are masked out by the query (for `~` as well as `!~`)
+                    return match_column(column.as_string_vector(), QString::fromStdString(regex), find_dictionary(&column));
+                };
+                return request.query->evaluate(dataframe, match_strings,
+                                               [this](auto& column) { return find_zone_map(&column); });
+            }));
+        }
+        catch (const std::runtime_error& e) {
+            qWarning() << "failed evaluating query: " << QString::fromStdString(e.what());
+            emit done_filtering(nullptr, generation);
+            return;
+        }
+        emit done_filtering(rows, generation);
+        return;
+    }
+
+    // plain substrings are searched for directly, globs with their compiled matcher, everything
+    // else with PCRE2, compiled and JIT-optimized once for the whole scan
+    std::string literal;
+    bool ignore_case = false;
+    const bool is_glob = request.mode == FilterMode::Glob;
+    const tfs::glob_pattern glob(is_glob ? pattern.toStdString() : std::string());
+    // `*text*` is a substring search ignoring case
+    const bool is_literal = is_glob ? glob.is_substring(literal) : literal_pattern(pattern, literal, ignore_case);
+    if (is_glob)
+        ignore_case = true;
+    QRegularExpression regex(is_literal || is_glob ? QString() : pattern);
+    if (!regex.isValid()) {
+        qWarning() << "failed compiling regex: " << regex.errorString();
+        // nullptr signals that the filtering failed
+        emit done_filtering(nullptr, generation);
+        return;
+    }
+    if (!is_literal && !is_glob)
+        regex.optimize();
+
+    // paces the batches of partial results
+    QElapsedTimer timer;
+    timer.start();
+    const size_t rows = df.size();
+
+    // the trigram index gives the rows that contain the substrings required by the pattern
+    if (index && df.visit([&](auto& dataframe) { return index->covers(dataframe); })) {
+        std::vector<std::string> required;
+        if (is_literal) {
+            required.push_back(literal);
+            for (auto& c : required.back()) c = tfs::helper::to_lower_ascii(c);
+        }
+        else if (is_glob)
+            required = glob.required_substrings();
+        else
+            required = tfs::helper::required_substrings(pattern.toStdString());
+
+        std::vector<size_t> indexed;
+        if (index->candidates(required, indexed)) {
+            tfs::bitmap indexed_rows(rows);
+            for (size_t i : indexed) indexed_rows.set(i);
+            if (candidates)
+                indexed_rows &= candidates->bits();
+            candidates = std::make_shared<const tfs::row_set>(std::move(indexed_rows));
+        }
+    }
+
+    std::vector<const tfs::string_column*> string_columns;
+    std::vector<const tfs::bitmap*> masks;
+    std::vector<const tfs::string_dictionary*> dicts;
+    df.visit([&](auto& dataframe) {
+        for (size_t c = 0; c < dataframe.column_count(); c++)
         {
-        const auto& col = df->get_column(c);
-        if (col.get_type() == tfs::DataType::S)
-            string_columns.push_back(c);
+        const auto& col = dataframe.get_column(c);
+        if (col.get_type() == tfs::DataType::S) {
+            string_columns.push_back(&col.as_string_vector());
+            masks.push_back(col.validity_mask());
+            dicts.push_back(find_dictionary(&col));
         }
+        }
+    });
+
+    // every cell is matched from a buffer of the scanning thread, the subject has been built
+    // by us and doesn't need to be checked for broken UTF-16
+    auto matches = [&](std::string_view cell, QString& subject) {
+        if (is_literal) {
+            const char* end = cell.data() + cell.size();
+            return tfs::helper::find_substring(cell.data(), end, literal, ignore_case) != end;
+        }
+        if (is_glob)
+            return glob.matches(cell);
+        to_subject(cell, subject);
+        return regex.match(subject, 0, QRegularExpression::NormalMatch,
+                           QRegularExpression::DontCheckSubjectStringMatchOption).hasMatch();
+    };
+
+    // columns with few distinct values are matched once per value, their cells look the result up
+    std::vector<std::vector<uint8_t>> tables(string_columns.size());
+    for (size_t c = 0; c < string_columns.size(); c++) {
+        QString subject;
+        if (dicts[c])
+            tables[c] = dicts[c]->evaluate([&](std::string_view value) { return matches(value, subject); });
+    }
+    auto cell_matches = [&](size_t c, size_t i, QString& subject) {
+        return dicts[c] ? tables[c][dicts[c]->code(i)] != 0 : matches((*string_columns[c])[i], subject);
+    };
 
+    // the matches are set in `found`, every block of the scan writes its own words
+    tfs::bitmap found(rows);
 
-        for (size_t i = 0; i< df->size(); i++){
-        for (const auto& col: string_columns) {
-            const auto& data = df->get_column(col).as_string_vector()[i];
+    // rows are scanned 64 at a time: the candidates of the word, minus null cells, minus the
+    // rows that matched an earlier column
+    auto scan = [&](size_t first_word, size_t last_word) {
+        QString subject;
+        const tfs::bitmap::word_t all = ~tfs::bitmap::word_t(0);
+        for (size_t w = first_word; w < last_word; w++) {
+        if (is_stale(generation)) return;
+        const size_t first = w * tfs::bitmap::WORD_BITS;
+        const size_t in_word = std::min(rows - first, tfs::bitmap::WORD_BITS);
 
-            if (std::regex_search(data, filtermatch, regex)) {
-            buf->push_back(i);
-            break;
+        tfs::bitmap::word_t remaining = in_word == tfs::bitmap::WORD_BITS ? all : (tfs::bitmap::word_t(1) << in_word) - 1;
+        if (candidates)
+            remaining &= candidates->bits().data()[w];
+        tfs::bitmap::word_t matched = 0;
+        for (size_t c = 0; c < string_columns.size() && remaining; c++) {
+            tfs::bitmap::word_t todo = remaining & (masks[c] ? masks[c]->data()[w] : all);
+            while (todo) {
+                const size_t bit = tfs::helper::count_trailing_zeros(todo);
+                todo &= todo - 1;
+                if (cell_matches(c, first + bit, subject))
+                    matched |= tfs::bitmap::word_t(1) << bit;
             }
+            remaining &= ~matched;
         }
+        found.data()[w] = matched;
         }
+    };
+
+    // substrings are searched column by column through the whole block
+    auto scan_literal = [&](size_t first_word, size_t last_word) {
+        const size_t first = first_word * tfs::bitmap::WORD_BITS;
+        const size_t last = std::min(rows, last_word * tfs::bitmap::WORD_BITS);
+        for (size_t c = 0; c < string_columns.size(); c++) {
+            if (is_stale(generation)) return;
+            if (dicts[c]) {
+                const uint8_t* table = tables[c].data();
+                const uint32_t* codes = dicts[c]->codes();
+                for (size_t i = first; i < last; i++)
+                    if (table[codes[i]] && (!masks[c] || (*masks[c])[i]))
+                        found.set(i);
+                continue;
+            }
+            string_columns[c]->for_each_containing(literal, ignore_case, first, last, [&](size_t i) {
+                if (!masks[c] || (*masks[c])[i])
+                    found.set(i);
+            });
+        }
+    };
+
+    // the words are split into blocks that are scanned by the global thread pool. Blocks don't
+    // share words, so they can write to `found` without locking
+    const size_t words = tfs::bitmap::word_count(rows);
+    std::vector<size_t> blocks((words + FILTER_BLOCK_WORDS - 1) / FILTER_BLOCK_WORDS);
+    std::iota(blocks.begin(), blocks.end(), 0);
+
+    // blocks finish in any order, the matches before the first block that is still running
+    // are final and go out in batches
+    std::mutex progress;
+    std::vector<bool> finished(blocks.size(), false);
+    size_t finished_prefix = 0;
+    size_t published_prefix = 0;
+    qint64 last_batch = 0;
+    auto publish = [&](size_t block) {
+        std::lock_guard<std::mutex> lock(progress);
+        finished[block] = true;
+        while (finished_prefix < finished.size() && finished[finished_prefix])
+            finished_prefix++;
+        if (finished_prefix == published_prefix || finished_prefix == finished.size()
+                || timer.elapsed() - last_batch < FILTER_BATCH_MSEC || is_stale(generation))
+            return;
 
-        emit done_filtering(buf);
+        // the words of finished blocks don't change anymore
+        tfs::bitmap batch(rows);
+        std::copy(found.data(), found.data() + finished_prefix * FILTER_BLOCK_WORDS, batch.data());
+        emit partial_results(std::make_shared<const tfs::row_set>(std::move(batch)), generation);
+        published_prefix = finished_prefix;
+        last_batch = timer.elapsed();
+    };
+
+    QtConcurrent::blockingMap(blocks, [&](size_t block) {
+        const size_t first_word = block * FILTER_BLOCK_WORDS;
+        const size_t last_word = std::min(words, first_word + FILTER_BLOCK_WORDS);
+        // with few candidates, matching single cells beats searching the whole block
+        if (is_literal && !candidates)
+            scan_literal(first_word, last_word);
+        else
+            scan(first_word, last_word);
+        publish(block);
+    });
+
+    if (is_stale(generation))
+        return;
+
+    emit done_filtering(std::make_shared<const tfs::row_set>(std::move(found)), generation);
+}
+
+void QFilterWorker::filter_fuzzy(const FilterRequest &request, quint64 generation)
+{
+    const std::string pattern = request.pattern.toStdString();
+    if (pattern.empty()) {
+        emit done_ranking(nullptr, generation);
+        return;
     }
-    catch (std::regex_error e) {
-        qWarning() << "failed compiling regex: " << QString::fromStdString(e.what());
-        // delete buf because it will be thrown away
-        delete buf;
-        // return nullptr to signal that the filtering failed
-        emit done_filtering(nullptr);
+    const tfs::fuzzy_pattern fuzzy(pattern);
+    // short patterns have to be found as they are
+    const unsigned max_distance = static_cast<unsigned>(fuzzy.size() / FILTER_FUZZY_CHARS_PER_EDIT);
+
+    const size_t rows = request.df.size();
+
+    std::vector<const tfs::string_column*> string_columns;
+    std::vector<const tfs::bitmap*> masks;
+    std::vector<const tfs::string_dictionary*> dicts;
+    request.df.visit([&](auto& dataframe) {
+        for (size_t c = 0; c < dataframe.column_count(); c++) {
+            const auto& col = dataframe.get_column(c);
+            if (col.get_type() == tfs::DataType::S) {
+                string_columns.push_back(&col.as_string_vector());
+                masks.push_back(col.validity_mask());
+                dicts.push_back(find_dictionary(&col));
+            }
+        }
+    });
 
+    // columns with few distinct values are measured once per value
+    std::vector<std::vector<uint8_t>> tables(string_columns.size());
+    for (size_t c = 0; c < string_columns.size(); c++) {
+        if (!dicts[c]) continue;
+        tables[c].resize(dicts[c]->size());
+        for (uint32_t code = 0; code < dicts[c]->size(); code++)
+            tables[c][code] = static_cast<uint8_t>(fuzzy.distance(dicts[c]->value(code)));
     }
 
+    // every block keeps its closest rows, and merges them into `best` when it is done
+    std::mutex merging;
+    std::vector<tfs::fuzzy_match> best;
+    const size_t block_rows = FILTER_BLOCK_WORDS * tfs::bitmap::WORD_BITS;
+    std::vector<size_t> blocks((rows + block_rows - 1) / block_rows);
+    std::iota(blocks.begin(), blocks.end(), 0);
+    QtConcurrent::blockingMap(blocks, [&](size_t block) {
+        const size_t first = block * block_rows;
+        const size_t last = std::min(rows, first + block_rows);
+        std::vector<tfs::fuzzy_match> found;
+        for (size_t i = first; i < last; i++) {
+            if ((i - first) % tfs::bitmap::WORD_BITS == 0 && is_stale(generation)) return;
+            unsigned distance = max_distance + 1;
+            for (size_t c = 0; c < string_columns.size() && distance > 0; c++) {
+                if (masks[c] && !(*masks[c])[i]) continue;
+                distance = std::min(distance, dicts[c] ? tables[c][dicts[c]->code(i)]
+                                                       : fuzzy.distance((*string_columns[c])[i]));
+            }
+            if (distance <= max_distance)
+                found.push_back({distance, i});
+        }
+        tfs::helper::keep_best(found, FILTER_FUZZY_MATCHES);
+
+        std::lock_guard<std::mutex> lock(merging);
+        best.insert(best.end(), found.begin(), found.end());
+        tfs::helper::keep_best(best, FILTER_FUZZY_MATCHES);
+    });
+
+    if (is_stale(generation))
+        return;
+
+    auto ranking = std::make_shared<std::vector<size_t>>();
+    ranking->reserve(best.size());
+    for (auto& match : best)
+        ranking->push_back(match.row);
+    emit done_ranking(ranking, generation);
+}
+
+tfs::bitmap QFilterWorker::match_column(const tfs::string_column &strings, const QString &pattern,
+                                        const tfs::string_dictionary *dictionary)
+{
+    std::string literal;
+    bool ignore_case = false;
+    // substrings without quotes are found in the cells as they are, quotes included
+    const bool is_literal = literal_pattern(pattern, literal, ignore_case) && literal.find('"') == std::string::npos;
+    QRegularExpression regex(is_literal ? QString() : pattern);
+    if (!regex.isValid())
+        throw std::runtime_error("invalid regular expression " + pattern.toStdString() + ": " + regex.errorString().toStdString());
+    if (!is_literal)
+        regex.optimize();
+
+    // with a dictionary, the distinct values are matched up front
+    std::vector<uint8_t> table;
+    if (dictionary) {
+        QString subject;
+        table = dictionary->evaluate([&](std::string_view value) {
+            if (is_literal)
+                return tfs::helper::find_substring(value.data(), value.data() + value.size(), literal, ignore_case)
+                        != value.data() + value.size();
+            to_subject(tfs::helper::unquoted(value), subject);
+            return regex.match(subject, 0, QRegularExpression::NormalMatch,
+                               QRegularExpression::DontCheckSubjectStringMatchOption).hasMatch();
+        });
+    }
 
+    // blocks start at word boundaries, so the tasks never write to the same word
+    const size_t rows = strings.size();
+    const size_t block_rows = FILTER_BLOCK_WORDS * tfs::bitmap::WORD_BITS;
+    tfs::bitmap matched(rows);
+    std::vector<size_t> blocks((rows + block_rows - 1) / block_rows);
+    std::iota(blocks.begin(), blocks.end(), 0);
+    QtConcurrent::blockingMap(blocks, [&](size_t block) {
+        const size_t first = block * block_rows;
+        const size_t last = std::min(rows, first + block_rows);
+        if (dictionary) {
+            const uint32_t* codes = dictionary->codes();
+            for (size_t i = first; i < last; i++)
+                if (table[codes[i]])
+                    matched.set(i);
+            return;
+        }
+        if (is_literal) {
+            strings.for_each_containing(literal, ignore_case, first, last, [&](size_t i) { matched.set(i); });
+            return;
+        }
+        QString subject;
+        for (size_t i = first; i < last; i++) {
+            to_subject(tfs::helper::unquoted(strings[i]), subject);
+            if (regex.match(subject, 0, QRegularExpression::NormalMatch,
+                            QRegularExpression::DontCheckSubjectStringMatchOption).hasMatch())
+                matched.set(i);
+        }
+    });
+    return matched;
+}
+
+void QFilterWorker::update_column_cache(const AnyDataframe &df)
+{
+    decltype(column_cache) current;
+    df.visit([&](auto& dataframe) {
+        // positions in `current` of the columns that are new (after opening or editing)
+        std::vector<size_t> missing;
+        for (size_t c = 0; c < dataframe.column_count(); c++) {
+            const auto type = dataframe.get_column(c).get_type();
+            if (type != tfs::DataType::S && type != tfs::DataType::LE && type != tfs::DataType::D) continue;
+            std::shared_ptr<const void> column = dataframe.share_column(c);
+            auto known = std::find_if(column_cache.begin(), column_cache.end(),
+                                      [&](auto& aids) { return aids.column == column; });
+            if (known == column_cache.end()) {
+                missing.push_back(current.size());
+                current.push_back({column, nullptr, nullptr});
+            }
+            else
+                current.push_back(*known);
+        }
+        if (missing.empty())
+            return;
+
+        QtConcurrent::blockingMap(missing, [&](size_t k) {
+            using column_t = std::decay_t<decltype(dataframe.get_column(0))>;
+            auto& column = *static_cast<const column_t*>(current[k].column.get());
+            if (column.get_type() != tfs::DataType::S) {
+                current[k].zones = std::make_shared<const tfs::zone_map>(tfs::zone_map::build(column));
+                return;
+            }
+            auto& strings = column.as_string_vector();
+            auto dictionary = std::make_shared<tfs::string_dictionary>();
+            if (tfs::string_dictionary::build(strings, strings.size() / FILTER_DICTIONARY_RATIO, *dictionary))
+                current[k].dictionary = dictionary;
+        });
+    });
+    column_cache = std::move(current);
+}
+
+const tfs::string_dictionary *QFilterWorker::find_dictionary(const void *column) const
+{
+    for (auto& aids : column_cache)
+        if (aids.column.get() == column)
+            return aids.dictionary.get();
+    return nullptr;
+}
+
+const tfs::zone_map *QFilterWorker::find_zone_map(const void *column) const
+{
+    for (auto& aids : column_cache)
+        if (aids.column.get() == column)
+            return aids.zones.get();
+    return nullptr;
+}
+
+bool QFilterWorker::literal_pattern(const QString &pattern, std::string &literal, bool &ignore_case)
+{
+    QStringView rest(pattern);
+    ignore_case = rest.startsWith(QLatin1String("(?i)"));
+    if (ignore_case)
+        rest = rest.mid(4);
+
+    literal.clear();
+    for (int i = 0; i < rest.size(); i++) {
+        if (rest[i].unicode() >= 0x80) return false;
+        char c = rest[i].toLatin1();
+        if (c == '\\') {
+            // escaped punctuation stands for itself, escaped letters and digits are classes,
+            // anchors, back references, ...
+            if (++i == rest.size() || rest[i].unicode() >= 0x80 || rest[i].isLetterOrNumber())
+                return false;
+            c = rest[i].toLatin1();
+        }
+        else if (std::strchr("^$.|?*+()[]{}", c))
+            return false;
+        literal += ignore_case ? tfs::helper::to_lower_ascii(c) : c;
+    }
+    return !literal.empty();
+}
+
+bool QFilterWorker::narrows(const QString &old_pattern, const QString &new_pattern)
+{
+    if (old_pattern.isEmpty() || !new_pattern.startsWith(old_pattern))
+        return false;
+
+    // appended atoms make a match harder, quantifiers (`*`, `?`, `{0,}`), alternatives (`|`)
+    // and closing groups could make it easier
+    for (int i = old_pattern.size(); i < new_pattern.size(); i++) {
+        const QChar c = new_pattern[i];
+        if (!(c.isLetterOrNumber() || c == '_' || c == '.' || c == ' ' || c == '-' || c == ':'))
+            return false;
+    }
+
+    // the appended characters must not continue an escape at the end of the old pattern
+    // (`\1` -> `\12`, `\x4` -> `\x41`)
+    int last_escape = -1;
+    for (int i = 0; i < old_pattern.size(); i++)
+        if (old_pattern[i] == '\\')
+            last_escape = i++;
+    if (last_escape >= 0) {
+        if (last_escape + 1 >= old_pattern.size())
+            return false;
+        const QChar escaped = old_pattern[last_escape + 1];
+        if (escaped.isDigit() || QStringLiteral("xocgkpPNuQE").contains(escaped))
+            return false;
+    }
+    return true;
 }
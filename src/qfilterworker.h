@@ -2,28 +2,192 @@
 #define QFILTERWORKER_H
 
 #include <QObject>
-#include <regex>
-#include "tfs_dataframe.h"
+#include <atomic>
+#include <memory>
+#include "anydataframe.h"
+#include "tfs_trigram.h"
+#include "tfs_query.h"
+#include "tfs_dictionary.h"
+#include "tfs_zonemap.h"
+#include "tfs_fuzzy.h"
+#include "tfs_glob.h"
 
+/**
+ * @brief Number of 64 row words scanned by one task of the thread pool
+ */
+constexpr size_t FILTER_BLOCK_WORDS = 256;
+
+/**
+ * @brief Minimum time between two batches of partial results of a running search
+ */
+constexpr int FILTER_BATCH_MSEC = 50;
+
+/**
+ * @brief String columns are searched through their dictionary (see `tfs::string_dictionary`)
+ * if they have at most one distinct value per this many rows
+ */
+constexpr size_t FILTER_DICTIONARY_RATIO = 16;
+
+/**
+ * @brief Number of closest rows shown by a fuzzy search
+ */
+constexpr size_t FILTER_FUZZY_MATCHES = 200;
+
+/**
+ * @brief A fuzzy search shows rows that are at most one edit per this many characters of
+ * the pattern away from it
+ */
+constexpr size_t FILTER_FUZZY_CHARS_PER_EDIT = 3;
+
+/**
+ * @brief How the search box pattern is read
+ */
+enum class FilterMode {
+    // regular expression, or query (see tfs_query.h)
+    Regex,
+    // the rows closest to the pattern by edit distance (see tfs_fuzzy.h)
+    Fuzzy,
+    // MAD-X style pattern like `MQ*R1*` (see tfs_glob.h)
+    Glob,
+};
+
+/**
+ * @brief A search for `QFilterWorker::filter`
+ */
+struct FilterRequest {
+    // a regular expression matched against all string columns, unless `query` is set
+    QString pattern;
+    // `Glob` reads `pattern` as glob, `Fuzzy` searches for the rows closest to it (all other
+    // fields are ignored then)
+    FilterMode mode = FilterMode::Regex;
+    // a snapshot, so edits made meanwhile don't disturb the search
+    AnyDataframe df;
+    // the rows to search in, nullptr for all rows
+    std::shared_ptr<const tfs::row_set> candidates;
+    // narrows the rows down if it has been built for the string columns of `df`
+    std::shared_ptr<const tfs::trigram_index> index;
+    // `pattern` parsed as query (see tfs_query.h), nullptr if it is a regular expression
+    std::shared_ptr<const tfs::query> query;
+};
 
 // for multithreaded filtering and searhing
 class QFilterWorker : public QObject {
 
     Q_OBJECT
 public:
-    QFilterWorker(tfs::dataframe<double>* df)
-        : df(df), keep_running(true) {}
+    /**
+     * @brief `latest` is the generation of the newest request, counted up by the requester.
+     * Requests with an older generation are stale: they are skipped, or stop scanning as soon
+     * as `latest` moves on.
+     */
+    explicit QFilterWorker(std::shared_ptr<const std::atomic<quint64>> latest)
+        : latest(std::move(latest)) {}
+
+    typedef std::shared_ptr<const tfs::row_set> rows_t;
+    typedef std::shared_ptr<const tfs::trigram_index> index_t;
+    typedef std::shared_ptr<const tfs::query> query_t;
+    // rows in the order they are shown
+    typedef std::shared_ptr<const std::vector<size_t>> ranking_t;
+
+    /**
+     * @brief Whether every row matching `new_pattern` also matches `old_pattern`, as far as
+     * that can be told cheaply. True if `new_pattern` is `old_pattern` with some plain
+     * characters appended (the common case while typing).
+     */
+    static bool narrows(const QString& old_pattern, const QString& new_pattern);
+
+    /**
+     * @brief Whether `pattern` is a plain substring (escaped punctuation like `\.` allowed),
+     * optionally preceded by `(?i)` for ASCII case insensitive matching. Sets `literal` to
+     * the substring (in lower case if `ignore_case`).
+     */
+    static bool literal_pattern(const QString& pattern, std::string& literal, bool& ignore_case);
+
+    /**
+     * @brief The rows of `strings` matching the regular expression `pattern`, scanned in parallel.
+     * Cells are matched without the quotes around TFS strings, as in `NAME ~ ^BPM`. With the `dictionary` of `strings`, the pattern is only matched against the distinct values.
+     * Throws `std::runtime_error` if `pattern` is not valid.
+     */
+    static tfs::bitmap match_column(const tfs::string_column& strings, const QString& pattern,
+                                    const tfs::string_dictionary* dictionary = nullptr);
 
 public slots:
-    void filter(const QString& pattern, std::vector<size_t>* buf);
+    /**
+     * @brief Collects the rows of `request.df` matching `request.query`, or where any string
+     * column matches `request.pattern` (a Perl compatible regular expression, see `QRegularExpression`,
+     * or a glob pattern in `FilterMode::Glob`).
+     *
+     * The scan is spread over the global thread pool. While it runs, the matches found so far
+     * are emitted by `partial_results` every `FILTER_BATCH_MSEC`. If the request gets stale,
+     * nothing more is emitted.
+     *
+     * Fuzzy requests emit `done_ranking` instead.
+     */
+    void filter(const FilterRequest& request, quint64 generation);
 
 signals:
-    void done_filtering(std::vector<size_t>* buf);
+    /**
+     * @brief The matches in the rows scanned so far, which are all rows before some row:
+     * every batch has the rows of the one before and more rows after these.
+     * Emitted from the threads of the pool.
+     */
+    void partial_results(QFilterWorker::rows_t rows, quint64 generation);
+
+    /**
+     * @brief The rows found for the request of `generation`, nullptr if the search failed
+     */
+    void done_filtering(QFilterWorker::rows_t rows, quint64 generation);
+
+    /**
+     * @brief The rows closest to the pattern of a fuzzy request, closest first (rows that are
+     * equally close in file order), nullptr if the search failed
+     */
+    void done_ranking(QFilterWorker::ranking_t ranking, quint64 generation);
 
 private:
-    bool keep_running;
-    tfs::dataframe<double> *df;
-    //std::vector<size_t>* indices;
+    std::shared_ptr<const std::atomic<quint64>> latest;
+
+    // what speeds up searching a column, built once per column
+    struct column_aids {
+        // kept alive, so the address can't be reused
+        std::shared_ptr<const void> column;
+        // string columns, unless they have too many distinct values
+        std::shared_ptr<const tfs::string_dictionary> dictionary;
+        // %le and %d columns
+        std::shared_ptr<const tfs::zone_map> zones;
+    };
+    // the aids of the columns of the latest request. Only used on the worker thread
+    std::vector<column_aids> column_cache;
+
+    /**
+     * @brief Ranks the rows of `request.df` by the edit distance of their closest string cell
+     * to `request.pattern`, in parallel
+     */
+    void filter_fuzzy(const FilterRequest& request, quint64 generation);
+
+    /**
+     * @brief Keeps the aids of the columns of `df`, building those that are missing, and
+     * drops the others
+     */
+    void update_column_cache(const AnyDataframe& df);
+
+    /**
+     * @brief The dictionary of `column`, nullptr if it has none
+     */
+    const tfs::string_dictionary* find_dictionary(const void* column) const;
+
+    /**
+     * @brief The zone map of `column`, nullptr if it has none
+     */
+    const tfs::zone_map* find_zone_map(const void* column) const;
+
+    bool is_stale(quint64 generation) const {
+        return latest->load(std::memory_order_relaxed) != generation;
+    }
 };
 
+Q_DECLARE_METATYPE(QFilterWorker::rows_t)
+Q_DECLARE_METATYPE(QFilterWorker::ranking_t)
+Q_DECLARE_METATYPE(FilterRequest)
+
 #endif // QFILTERWORKER_H
@@ -0,0 +1,419 @@
+/**
+ * @file tfs_bitmap.h
+ * @author awegsche (you@domain.com)
+ * @brief Packed bit vectors.
+ *
+ * Used as payload of `%b` columns. Bits are packed into 64 bit words, so whole words can be
+ * combined (AND / OR / NOT), counted (popcount) and read / written in bulk.
+ *
+ * `row_set` adds a rank directory on top, for selections of rows (search results, plotted or
+ * exported rows) that are shown one after the other: the `k`th selected row is found in
+ * logarithmic time, without a list of 8 bytes per row.
+ *
+ * @version 1.0
+ * @date 2021-03-08
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <memory_resource>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace tfs
+{
+namespace helper {
+/**
+         * @brief Number of set bits in `word`
+         */
+inline size_t popcount(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_popcountll(word));
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ull);
+    word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+    word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return static_cast<size_t>((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+/**
+         * @brief Index of the lowest set bit in `word`, `word` must not be zero
+         */
+inline size_t count_trailing_zeros(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_ctzll(word));
+#else
+    return popcount((word & (~word + 1)) - 1);
+#endif
+}
+
+/**
+         * @brief Index of the `k`th (counting from zero) set bit in `word`, `k` has to be less than
+         * `popcount(word)`
+         */
+inline size_t select_in_word(uint64_t word, size_t k) {
+    // skip whole bytes first, then the bits of the byte with the `k`th bit
+    size_t offset = 0;
+    for (size_t n = popcount(word & 0xff); n <= k; n = popcount(word & 0xff)) {
+        k -= n;
+        word >>= 8;
+        offset += 8;
+    }
+    for (; k > 0; k--)
+        word &= word - 1;
+    return offset + count_trailing_zeros(word);
+}
+}
+
+/**
+     * @brief A vector of bits, packed into 64 bit words.
+     *
+     * Unlike `std::vector<bool>` the underlying words are accessible, which allows
+     * word-at-a-time AND / OR / NOT, popcount-based counting and bulk binary I/O.
+     *
+     * Invariant: the bits of the last word beyond `size()` are always zero.
+     */
+class bitmap {
+public:
+    typedef uint64_t word_t;
+    static constexpr size_t WORD_BITS = 64;
+
+    bitmap() = default;
+
+    /**
+     * @brief Construct an empty bitmap that allocates from `resource`
+     */
+    explicit bitmap(std::pmr::memory_resource* resource) : words(resource) {}
+
+    /**
+     * @brief Construct a bitmap of `n` bits, all set to `value`
+     */
+    explicit bitmap(size_t n, bool value = false,
+                    std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : words(resource) {
+        resize(n, value);
+    }
+
+    size_t size() const { return bits; }
+    bool empty() const { return bits == 0; }
+
+    bool operator[](size_t i) const {
+        return (words[i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+    }
+    bool test(size_t i) const {
+        if (i >= bits) throw std::out_of_range("bitmap index out of range");
+        return (*this)[i];
+    }
+
+    void set(size_t i, bool value = true) {
+        const word_t mask = word_t(1) << (i % WORD_BITS);
+        if (value)
+            words[i / WORD_BITS] |= mask;
+        else
+            words[i / WORD_BITS] &= ~mask;
+    }
+    void reset(size_t i) { set(i, false); }
+
+    /**
+     * @brief Sets the bits `[first, last)`, whole words at a time
+     */
+    void set_range(size_t first, size_t last) {
+        if (first >= last) return;
+        const size_t first_word = first / WORD_BITS;
+        const size_t last_word = (last - 1) / WORD_BITS;
+        const word_t head = ~word_t(0) << (first % WORD_BITS);
+        const word_t tail = ~word_t(0) >> (WORD_BITS - 1 - (last - 1) % WORD_BITS);
+        if (first_word == last_word) {
+            words[first_word] |= head & tail;
+            return;
+        }
+        words[first_word] |= head;
+        std::fill(words.begin() + first_word + 1, words.begin() + last_word, ~word_t(0));
+        words[last_word] |= tail;
+    }
+
+    void push_back(bool value) {
+        if (bits % WORD_BITS == 0)
+            words.push_back(0);
+        bits++;
+        if (value) set(bits - 1);
+    }
+
+    void resize(size_t n, bool value = false) {
+        const size_t old_bits = bits;
+        words.resize(word_count(n), value ? ~word_t(0) : word_t(0));
+        bits = n;
+        if (value && old_bits < n && old_bits % WORD_BITS != 0)
+            words[old_bits / WORD_BITS] |= ~word_t(0) << (old_bits % WORD_BITS);
+        clear_tail();
+    }
+
+    void reserve(size_t n) { words.reserve(word_count(n)); }
+
+    void clear() {
+        words.clear();
+        bits = 0;
+    }
+
+    /**
+     * @brief Number of set bits
+     */
+    size_t count() const {
+        size_t n = 0;
+        for (word_t w : words)
+            n += helper::popcount(w);
+        return n;
+    }
+
+    bool all() const { return count() == bits; }
+    bool any() const {
+        for (word_t w : words)
+            if (w) return true;
+        return false;
+    }
+    bool none() const { return !any(); }
+
+    /**
+     * @brief Bitwise AND with a bitmap of the same size
+     */
+    bitmap& operator&=(const bitmap& other) {
+        check_size(other);
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] &= other.words[i];
+        return *this;
+    }
+
+    /**
+     * @brief Bitwise OR with a bitmap of the same size
+     */
+    bitmap& operator|=(const bitmap& other) {
+        check_size(other);
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] |= other.words[i];
+        return *this;
+    }
+
+    /**
+     * @brief Bitwise AND NOT (clears all bits that are set in `other`)
+     */
+    bitmap& and_not(const bitmap& other) {
+        check_size(other);
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] &= ~other.words[i];
+        return *this;
+    }
+
+    /**
+     * @brief Inverts all bits
+     */
+    bitmap& flip() {
+        for (auto& w : words)
+            w = ~w;
+        clear_tail();
+        return *this;
+    }
+
+    friend bitmap operator&(bitmap a, const bitmap& b) { return a &= b; }
+    friend bitmap operator|(bitmap a, const bitmap& b) { return a |= b; }
+    friend bitmap operator~(bitmap a) { return a.flip(); }
+
+    bool operator==(const bitmap& other) const { return bits == other.bits && words == other.words; }
+    bool operator!=(const bitmap& other) const { return !(*this == other); }
+
+    /**
+     * @brief Calls `fn(i)` for every set bit `i`, in ascending order.
+     * Words without set bits are skipped, full words are run through without looking at the bits.
+     */
+    template<typename F>
+    void for_each_set(F&& fn) const {
+        for (size_t w = 0; w < words.size(); w++) {
+            word_t word = words[w];
+            if (word == ~word_t(0)) {
+                for (size_t i = w * WORD_BITS, end = i + WORD_BITS; i < end; i++)
+                    fn(i);
+                continue;
+            }
+            while (word) {
+                fn(w * WORD_BITS + helper::count_trailing_zeros(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+    /**
+     * @brief Bytes allocated for the words
+     */
+    size_t allocated_bytes() const { return words.capacity() * sizeof(word_t); }
+
+    void shrink_to_fit() { words.shrink_to_fit(); }
+
+    /**
+     * @brief The memory resource the words are allocated from
+     */
+    std::pmr::memory_resource* resource() const { return words.get_allocator().resource(); }
+
+    const word_t* data() const { return words.data(); }
+    word_t* data() { return words.data(); }
+
+    /**
+     * @brief Number of words needed for `n` bits
+     */
+    static size_t word_count(size_t n) { return (n + WORD_BITS - 1) / WORD_BITS; }
+    size_t word_count() const { return words.size(); }
+
+    void write_to_binary(std::ostream& file) const {
+        file.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(word_t));
+    }
+
+    /**
+     * @brief Reads `n` bits written by `write_to_binary`
+     */
+    void read_from_binary(std::istream& file, size_t n) {
+        words.resize(word_count(n));
+        bits = n;
+        file.read(reinterpret_cast<char*>(words.data()), words.size() * sizeof(word_t));
+        clear_tail();
+    }
+
+private:
+    std::pmr::vector<word_t> words;
+    size_t bits = 0;
+
+    void clear_tail() {
+        if (bits % WORD_BITS != 0)
+            words.back() &= (word_t(1) << (bits % WORD_BITS)) - 1;
+    }
+
+    void check_size(const bitmap& other) const {
+        if (other.bits != bits) throw std::runtime_error("bitmaps have different sizes");
+    }
+};
+
+/**
+     * @brief An immutable set of rows out of `size()`, stored as bitmap with a rank directory.
+     *
+     * `rank` and `select` map between rows and their position in the set, so a view showing
+     * only the selected rows needs no list of row numbers. The directory holds the number
+     * of set bits before every `RANK_BLOCK_WORDS` words, which takes `select` to the right
+     * block by binary search and leaves at most that many words to count.
+     */
+class row_set {
+public:
+    static constexpr size_t RANK_BLOCK_WORDS = 8;
+
+    row_set() : ranks(1, 0) {}
+
+    /**
+     * @brief The rows set in `rows`
+     */
+    explicit row_set(bitmap rows) : rows(std::move(rows)) {
+        build_ranks();
+    }
+
+    /**
+     * @brief All `n` rows
+     */
+    static row_set all(size_t n) { return row_set(bitmap(n, true)); }
+
+    /**
+     * @brief Number of rows the set is taken from
+     */
+    size_t size() const { return rows.size(); }
+
+    /**
+     * @brief Number of rows in the set
+     */
+    size_t count() const { return ranks.back(); }
+
+    bool empty() const { return count() == 0; }
+
+    bool contains(size_t row) const { return row < rows.size() && rows[row]; }
+
+    /**
+     * @brief Number of rows in the set before `row`, which is the position of `row` if it
+     * is in the set
+     */
+    size_t rank(size_t row) const {
+        if (row >= rows.size()) return count();
+        const size_t word = row / bitmap::WORD_BITS;
+        const size_t block = word / RANK_BLOCK_WORDS;
+        size_t n = ranks[block];
+        for (size_t w = block * RANK_BLOCK_WORDS; w < word; w++)
+            n += helper::popcount(rows.data()[w]);
+        const size_t bit = row % bitmap::WORD_BITS;
+        if (bit)
+            n += helper::popcount(rows.data()[word] & ((bitmap::word_t(1) << bit) - 1));
+        return n;
+    }
+
+    /**
+     * @brief The `k`th row in the set (counting from zero). Throws `std::out_of_range` if
+     * `k >= count()`.
+     */
+    size_t select(size_t k) const {
+        if (k >= count()) throw std::out_of_range("row_set position out of range");
+        // the last block starting with less than `k + 1` rows before it
+        const size_t block = std::upper_bound(ranks.begin(), ranks.end(), k) - ranks.begin() - 1;
+        k -= ranks[block];
+        for (size_t w = block * RANK_BLOCK_WORDS;; w++) {
+            const size_t n = helper::popcount(rows.data()[w]);
+            if (k < n)
+                return w * bitmap::WORD_BITS + helper::select_in_word(rows.data()[w], k);
+            k -= n;
+        }
+    }
+
+    /**
+     * @brief Calls `fn(row)` for every row in the set, in ascending order
+     */
+    template<typename F>
+    void for_each(F&& fn) const { rows.for_each_set(std::forward<F>(fn)); }
+
+    /**
+     * @brief The rows as bitmap of `size()` bits
+     */
+    const bitmap& bits() const { return rows; }
+
+    friend row_set operator&(const row_set& a, const row_set& b) { return row_set(a.rows & b.rows); }
+    friend row_set operator|(const row_set& a, const row_set& b) { return row_set(a.rows | b.rows); }
+
+    /**
+     * @brief The rows of `a` that are not in `b`
+     */
+    friend row_set operator-(const row_set& a, const row_set& b) {
+        bitmap difference = a.rows;
+        return row_set(std::move(difference.and_not(b.rows)));
+    }
+
+    bool operator==(const row_set& other) const { return rows == other.rows; }
+    bool operator!=(const row_set& other) const { return rows != other.rows; }
+
+    /**
+     * @brief Bytes allocated for the bitmap and the rank directory
+     */
+    size_t allocated_bytes() const { return rows.allocated_bytes() + ranks.capacity() * sizeof(size_t); }
+
+private:
+    bitmap rows;
+    // `ranks[b]`: number of set bits in the words before word `b * RANK_BLOCK_WORDS`,
+    // the last entry is the total
+    std::vector<size_t> ranks;
+
+    void build_ranks() {
+        const size_t words = rows.word_count();
+        ranks.assign(1, 0);
+        ranks.reserve((words + RANK_BLOCK_WORDS - 1) / RANK_BLOCK_WORDS + 1);
+        size_t n = 0;
+        for (size_t w = 0; w < words; w++) {
+            n += helper::popcount(rows.data()[w]);
+            if ((w + 1) % RANK_BLOCK_WORDS == 0 || w + 1 == words)
+                ranks.push_back(n);
+        }
+    }
+};
+}  // namespace tfs
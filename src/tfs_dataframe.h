@@ -17,7 +17,6 @@
  *
  */
 #pragma once
-#include <map>
 #include <vector>
 #include <iostream>
 #include <iomanip>
@@ -25,7 +24,21 @@
 #include <fstream>
 #include <iterator>
 #include <complex>
+#include <cmath>
+#include <limits>
 #include <variant>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+
+#include "tfs_bitmap.h"
 
 namespace tfs
 {
@@ -63,6 +76,37 @@ inline std::string read_string(std::istream& stream) {
     stream.read(reinterpret_cast<char*>(&str[0]), size);
     return str;
 }
+
+/**
+         * @brief Reads `count` floating point numbers of `file_real_size` bytes each (as written by
+         * a `float` or `double` dataframe) into `out`, converting them if necessary.
+         *
+         * @tparam real the type to read into
+         */
+template<typename real>
+void read_reals(std::istream& stream, size_t count, uint32_t file_real_size, real* out) {
+    if (file_real_size == sizeof(real)) {
+        stream.read(reinterpret_cast<char*>(out), count * sizeof(real));
+        return;
+    }
+
+    auto convert = [&](auto tag) {
+        using file_real = decltype(tag);
+        std::vector<file_real> buffer(std::min<size_t>(count, 4096));
+        for (size_t done = 0; done < count; done += buffer.size()) {
+            const size_t n = std::min(buffer.size(), count - done);
+            stream.read(reinterpret_cast<char*>(buffer.data()), n * sizeof(file_real));
+            for (size_t i = 0; i < n; i++)
+                out[done + i] = static_cast<real>(buffer[i]);
+        }
+    };
+    if (file_real_size == sizeof(double))
+        convert(double());
+    else if (file_real_size == sizeof(float))
+        convert(float());
+    else
+        throw std::runtime_error("unsupported floating point size in binary file");
+}
 }
 /**
      * @brief Width for printing
@@ -70,6 +114,54 @@ inline std::string read_string(std::istream& stream) {
      */
 constexpr int FIELDWIDTH = 15;
 
+/**
+     * @brief Minimum width of a data field when writing TFS files.
+     * MAD-X writes its numbers in fields of 18 characters.
+     *
+     */
+constexpr int WRITE_FIELDWIDTH = 18;
+
+/**
+     * @brief Width of the property names in the header of a written TFS file
+     *
+     */
+constexpr int WRITE_PROPERTYWIDTH = 16;
+
+/**
+     * @brief Number of rows that are formatted in one go (by one thread) when writing TFS files
+     *
+     */
+constexpr size_t WRITE_BLOCKSIZE = 16384;
+
+/**
+     * @brief Magic number at the start of binary TFS files (`*.btfs`)
+     *
+     */
+constexpr char BINARY_MAGIC[4] = {'B', 'T', 'F', 'S'};
+
+/**
+     * @brief Container of column data. Allocates from the memory resource the column has been
+     * created with, see `dataframe::get_resource`.
+     */
+template<typename T>
+using column_storage = std::pmr::vector<T>;
+
+/**
+     * @brief Version of the binary format that is written.
+     * Files without magic number are read as version 0.
+     *
+     * - 0: strings are stored one by one, with their length
+     * - 1: magic number and version; string columns are stored as offsets and character buffer
+     *      `%b` columns are stored as packed 64 bit words
+     * - 2: the size of the floating point type (4 or 8) follows the version, so `float` and
+     *      `double` dataframes can read each other's files
+     * - 3: every column is followed by a flag and, if set, its validity bitmap
+     *
+     * Files may have more data after the last column (e.g. a `trigram_index`, see tfs_trigram.h),
+     * which is not read by `load_from_binary`.
+     */
+constexpr uint32_t BINARY_VERSION = 3;
+
 /**
      * @brief The TFS data types
      *
@@ -82,6 +174,266 @@ enum DataType {
     C,  // complex
 };
 
+namespace helper {
+/**
+         * @brief Appends `text` to `out`, padded with spaces to `width` characters.
+         *
+         * @param out the output buffer
+         * @param text the field content
+         * @param width the minimum width of the field
+         * @param left_aligned pad on the right (strings) instead of on the left (numbers)
+         */
+inline void append_field(std::string& out, std::string_view text, int width, bool left_aligned) {
+    size_t pad = text.size() < static_cast<size_t>(width) ? width - text.size() : 0;
+    if (!left_aligned) out.append(pad, ' ');
+    out.append(text.data(), text.size());
+    if (left_aligned) out.append(pad, ' ');
+}
+
+/**
+         * @brief Appends a number to `out`, right aligned in a field of `width` characters.
+         * Uses `std::to_chars`, i.e. the shortest representation that reads back to the same value.
+         *
+         * @tparam T `int`, `float` or `double`
+         */
+template<typename T>
+inline void append_number(std::string& out, T value, int width) {
+    char buf[32];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    append_field(out, std::string_view(buf, result.ptr - buf), width, false);
+}
+
+/**
+         * @brief Appends a TFS string to `out`, left aligned in a field of `width` characters.
+         * Surrounding whitespace is dropped, strings that are not quoted yet get quoted.
+         */
+inline void append_string(std::string& out, std::string_view str, int width) {
+    auto first = str.find_first_not_of(' ');
+    str = first == std::string_view::npos ? std::string_view() : str.substr(first, str.find_last_not_of(' ') - first + 1);
+
+    if (str.size() >= 2 && str.front() == '"' && str.back() == '"') {
+        append_field(out, str, width, true);
+        return;
+    }
+    out += '"';
+    out.append(str.data(), str.size());
+    out += '"';
+    if (str.size() + 2 < static_cast<size_t>(width))
+        out.append(width - str.size() - 2, ' ');
+}
+
+/**
+         * @brief Compares `s` to the lower case word `word`, ignoring the case of `s`
+         */
+inline bool equals_lowercase(std::string_view s, std::string_view word) {
+    if (s.size() != word.size()) return false;
+    for (size_t i = 0; i < s.size(); i++)
+        if ((s[i] | 0x20) != word[i]) return false;
+    return true;
+}
+
+inline char to_lower_ascii(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c;
+}
+
+/**
+         * @brief `s` without the quotes around TFS strings (`"BPM.10L1.B1"` -> `BPM.10L1.B1`)
+         */
+inline std::string_view unquoted(std::string_view s) {
+    if (s.size() >= 2 && s.front() == '"' && s.back() == '"')
+        return s.substr(1, s.size() - 2);
+    return s;
+}
+
+/**
+         * @brief Position of the first occurrence of `needle` in `[first, last)`, or `last` if there is none.
+         *
+         * Candidates are found with `memchr` on the first character of `needle` (on both of its cases
+         * if `ignore_case`), which scans many bytes at a time, and then verified.
+         * `ignore_case` folds ASCII letters only, `needle` has to be in lower case then.
+         */
+inline const char* find_substring(const char* first, const char* last, std::string_view needle, bool ignore_case) {
+    if (needle.empty()) return first;
+    if (static_cast<size_t>(last - first) < needle.size()) return last;
+
+    const char lead = needle[0];
+    const char other = ignore_case && lead >= 'a' && lead <= 'z' ? static_cast<char>(lead - 0x20) : lead;
+    // one past the last position a match can start at
+    const char* end = last - needle.size() + 1;
+    auto verify = [&](const char* p) {
+        if (!ignore_case)
+            return std::memcmp(p + 1, needle.data() + 1, needle.size() - 1) == 0;
+        for (size_t k = 1; k < needle.size(); k++)
+            if (to_lower_ascii(p[k]) != needle[k]) return false;
+        return true;
+    };
+
+    // scanned in windows, so a case that is rare doesn't make every call run to `end`.
+    // Within a window the next candidates of both cases are kept, no byte is scanned twice
+    constexpr size_t WINDOW = 1024;
+    while (first < end) {
+        const char* window_end = first + std::min<size_t>(WINDOW, end - first);
+        auto next = [&](char c, const char* from) {
+            auto p = static_cast<const char*>(std::memchr(from, c, window_end - from));
+            return p ? p : window_end;
+        };
+        const char* a = next(lead, first);
+        const char* b = other != lead ? next(other, first) : window_end;
+        while (true) {
+            const char* p = std::min(a, b);
+            if (p == window_end) break;
+            if (verify(p)) return p;
+            if (p == a)
+                a = next(lead, p + 1);
+            else
+                b = next(other, p + 1);
+        }
+        first = window_end;
+    }
+    return last;
+}
+
+/**
+         * @brief Parses a `%b` value. `true` (in any capitalisation) and `1` are true, everything else is false.
+         */
+inline bool parse_bool(std::string_view s) {
+    return s == "1" || equals_lowercase(s, "true");
+}
+
+/**
+         * @brief Parses a `%b` value strictly: `true` / `1` and `false` / `0` (in any capitalisation).
+         *
+         * @return false if `s` is neither
+         */
+inline bool parse_bool(std::string_view s, bool& value) {
+    value = s == "1" || equals_lowercase(s, "true");
+    return value || s == "0" || equals_lowercase(s, "false");
+}
+
+/**
+         * @brief Parses a whole token as number, `value` is left alone if that fails.
+         *
+         * @tparam T `int` or `double`
+         * @return false if `s` isn't a number or has trailing characters
+         */
+template<typename T>
+inline bool parse_number(std::string_view s, T& value) {
+    const char* last = s.data() + s.size();
+    const char* first = s.data();
+    if (first != last && *first == '+') first++;
+    auto result = std::from_chars(first, last, value);
+    return result.ec == std::errc() && result.ptr == last;
+}
+
+/**
+         * @brief Parses a floating point number at the start of `[first, last)`.
+         * Unlike `std::from_chars` a leading `+` is accepted.
+         *
+         * @return the end of the number or `nullptr` if there is none
+         */
+inline const char* parse_real(const char* first, const char* last, double& value) {
+    if (first != last && *first == '+') first++;
+    auto result = std::from_chars(first, last, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+/**
+         * @brief Parses a `%c` value.
+         * Accepted forms are `re`, `imj`, `re+imj`, `re-imj` (`i` instead of `j` works as well),
+         * optionally in parentheses as python prints them, and `(re,im)` as C++ prints them.
+         *
+         * @return false if `s` isn't a complex number, `re` and `im` hold what could be parsed
+         */
+inline bool parse_complex(std::string_view s, double& re, double& im) {
+    re = im = 0.0;
+    if (s.size() >= 2 && s.front() == '(' && s.back() == ')')
+        s = s.substr(1, s.size() - 2);
+
+    const char* first = s.data();
+    const char* last = first + s.size();
+    auto is_unit = [](char c) { return c == 'j' || c == 'i'; };
+
+    if (s.find(',') != std::string_view::npos) {
+        const char* p = parse_real(first, last, re);
+        if (!p || *p != ',') return false;
+        p = parse_real(p + 1, last, im);
+        return p == last;
+    }
+
+    double value;
+    const char* p = parse_real(first, last, value);
+    if (!p) return false;
+    if (p == last) {
+        re = value;
+        return true;
+    }
+    if (is_unit(*p) && p + 1 == last) {
+        im = value;
+        return true;
+    }
+    re = value;
+    if (*p != '+' && *p != '-') return false;
+    p = parse_real(p, last, im);
+    return p && p + 1 == last && is_unit(*p);
+}
+
+/**
+         * @brief Appends a `%c` value (`re+imj`) to `out`, right aligned in a field of `width` characters.
+         */
+template<typename T>
+inline void append_complex(std::string& out, const std::complex<T>& value, int width) {
+    char buf[64];
+    char* p = std::to_chars(buf, buf + 31, value.real()).ptr;
+    if (!std::signbit(value.imag())) *p++ = '+';
+    p = std::to_chars(p, buf + 63, value.imag()).ptr;
+    *p++ = 'j';
+    append_field(out, std::string_view(buf, p - buf), width, false);
+}
+
+/**
+         * @brief The width of a column in a written TFS file.
+         * At least `WRITE_FIELDWIDTH`, but wide enough for the column name.
+         */
+inline int field_width(const std::string& column_name) {
+    return std::max(WRITE_FIELDWIDTH, static_cast<int>(column_name.size()));
+}
+
+/**
+         * @brief Number of threads used for parallel work
+         */
+inline size_t thread_count() {
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+/**
+         * @brief Calls `fn(i)` for every `i` in `[0, count)`, distributed over `thread_count()` threads.
+         * Returns when all calls have finished.
+         *
+         * @param count the number of work items
+         * @param fn the work, must be safe to call concurrently for different `i`
+         */
+template<typename F>
+void parallel_for(size_t count, F&& fn) {
+    size_t nthreads = std::min(count, thread_count());
+    if (nthreads <= 1) {
+        for (size_t i = 0; i < count; i++) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++) fn(i);
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(nthreads - 1);
+    for (size_t t = 1; t < nthreads; t++)
+        threads.emplace_back(work);
+    work();
+    for (auto& t : threads)
+        t.join();
+}
+}
+
 /**
      * @brief A kind of variant (but restricted to TFS data types)
      * Convenience constructors from the corresponding types exist.
@@ -99,6 +451,7 @@ struct data_value {
     data_value(int i) :type(DataType::D) { payload = i;}
     data_value(double d) :type(DataType::LE) { payload = static_cast<real>(d);}
     data_value(bool b) :type(DataType::B) { payload = b;}
+    data_value(const std::complex<double>& c) :type(DataType::C) { payload = std::complex<real>(c);}
     data_value(const std::string& s) : type(DataType::S), payload(s) {}
     data_value(const char* s) : type(DataType::S), payload(std::string(s)) {}
 
@@ -115,9 +468,14 @@ struct data_value {
             break;
         case DataType::S:
             return get_string();
+        case DataType::B:
+            return get_bool() ? "true" : "false";
         case DataType::C:
-            ss << get_complex();
-            break;
+        {
+            std::string out;
+            helper::append_complex(out, get_complex(), 0);
+            return out;
+        }
         }
         return ss.str();
     }
@@ -136,10 +494,28 @@ struct data_value {
             helper::write_string(file, get_string());
             break;
         }
+        case DataType::B:
+        {
+            char b = get_bool() ? 1 : 0;
+            file.write(&b, 1);
+            break;
+        }
+        case DataType::C:
+        {
+            real parts[2] = { get_complex().real(), get_complex().imag() };
+            file.write(reinterpret_cast<const char*>(parts), sizeof(parts));
+            break;
+        }
         }
     }
 
-    static data_value read_from_binary(std::istream& file) {
+    /**
+     * @brief Reads a value written by `write_to_binary`
+     *
+     * @param file
+     * @param real_size the size of the floating point numbers in the file
+     */
+    static data_value read_from_binary(std::istream& file, uint32_t real_size = sizeof(real)) {
         DataType t;
         file.read(reinterpret_cast<char*>(&t), sizeof(DataType));
 
@@ -151,9 +527,24 @@ struct data_value {
         }
         case DataType::LE: {
             real r;
-            file.read(reinterpret_cast<char*>(&r), sizeof(real));
+            helper::read_reals(file, 1, real_size, &r);
             return data_value(r);
         }
+        case DataType::D: {
+            int i;
+            file.read(reinterpret_cast<char*>(&i), sizeof(int));
+            return data_value(i);
+        }
+        case DataType::B: {
+            char b;
+            file.read(&b, 1);
+            return data_value(b != 0);
+        }
+        case DataType::C: {
+            real parts[2];
+            helper::read_reals(file, 2, real_size, parts);
+            return data_value(std::complex<double>(parts[0], parts[1]));
+        }
 
         default:
             throw std::runtime_error("not implemented");
@@ -201,6 +592,17 @@ struct data_value {
         if (type == DataType::C) return std::get<std::complex<real>>(payload);
         if (type == DataType::LE)
             return std::complex<real>(std::get<real>(payload), 0.0);
+        throw std::runtime_error("value is neither complex nor real");
+    }
+
+    /**
+     * @brief Returns the internal value as bool.
+     * Throws an error if the type is not `%b`.
+     *
+     * @return bool
+     */
+    bool get_bool() const {
+        return std::get<bool>(payload);
     }
 
     /**
@@ -240,161 +642,981 @@ struct data_property {
         value.write_to_binary(file);
     }
 
-    static data_property read_from_binary(std::istream& file) {
+    static data_property read_from_binary(std::istream& file, uint32_t real_size = sizeof(real)) {
         auto name = helper::read_string(file);
-        auto value = data_value<real>::read_from_binary(file);
+        auto value = data_value<real>::read_from_binary(file, real_size);
 
         return data_property(name, value);
     }
 };
 
 /**
-     * @brief TFS data column.
-     *
-     * @tparam real
+     * @brief Memory allocated by a column or dataframe, in bytes. See `data_vector::memory_usage`.
      */
-template <typename real>
-class data_vector {
-    std::variant<
-        std::vector<std::string>,
-        std::vector<real>,
-        std::vector<int>,
-        std::vector<bool>
-        > payload;
-    DataType type;
-    std::string name;
+struct memory_footprint {
+    // the cells: numbers, packed bits, string offsets
+    size_t payload = 0;
+    // the characters of string columns
+    size_t strings = 0;
+    // everything else: validity bitmaps, names, properties, lookup indices
+    size_t index = 0;
+
+    size_t total() const { return payload + strings + index; }
+
+    memory_footprint& operator+=(const memory_footprint& other) {
+        payload += other.payload;
+        strings += other.strings;
+        index += other.index;
+        return *this;
+    }
+};
 
-public:
-    /**
-     * @brief Construct a new data vector object with the given datatype
+/**
+     * @brief Storage of a `%s` column.
      *
-     * @param t
-     * @param s
+     * All strings are stored back to back in one contiguous character buffer, the `i`th string
+     * spans `[offsets[i], offsets[i+1])` (the same layout as Arrow's string arrays).
+     * Compared to `std::vector<std::string>` this saves the 32 byte header and the heap
+     * allocation per cell, and scans over all strings of a column run through contiguous memory.
+     *
+     * Elements are accessed as `std::string_view`s, which stay valid until the next `push_back`.
      */
-    data_vector(DataType t, const std::string& s) : type(t), name(s)  {
-
-        switch(t) {
-        case DataType::B:
-            payload = std::vector<bool>();
-            break;
-        case DataType::LE:
-            payload = std::vector<real>();
-            break;
-        case DataType::D:
-            payload = std::vector<int>();
-            break;
-        case DataType::S:
-            payload = std::vector<std::string>();
-            break;
-        }
-    }
+class string_column {
+public:
+    typedef uint64_t offset_t;
 
-    const std::vector<real>& as_double_vector() const {
-        return std::get<std::vector<real>>(payload);
-    }
-    const std::vector<std::string>& as_string_vector() const {
-        return std::get<std::vector<std::string>>(payload);
-    }
-    const std::vector<bool>& as_bool_vector() const {
-        return std::get<std::vector<bool>>(payload);
+    /**
+     * @brief Iterates over the elements, yielding `std::string_view`s
+     */
+    class const_iterator {
+        const string_column* column;
+        size_t index;
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::string_view;
+
+        const_iterator(const string_column* column, size_t index) : column(column), index(index) {}
+
+        std::string_view operator*() const { return (*column)[index]; }
+        const_iterator& operator++() { ++index; return *this; }
+        const_iterator operator++(int) { auto it = *this; ++index; return it; }
+        const_iterator& operator+=(difference_type n) { index += n; return *this; }
+        const_iterator operator+(difference_type n) const { return const_iterator(column, index + n); }
+        difference_type operator-(const const_iterator& other) const { return index - other.index; }
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+    };
+
+    explicit string_column(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : chars(resource), offsets(1, 0, resource) {}
+
+    size_t size() const { return offsets.size() - 1; }
+    bool empty() const { return size() == 0; }
+
+    std::string_view operator[](size_t i) const {
+        return std::string_view(chars.data() + offsets[i], offsets[i + 1] - offsets[i]);
     }
-    const std::vector<int>& as_int_vector() const {
-        return std::get<std::vector<int>>(payload);
+    std::string_view at(size_t i) const {
+        if (i >= size()) throw std::out_of_range("string_column index out of range");
+        return (*this)[i];
     }
 
-    std::vector<real>& as_double_vector() {
-       return const_cast<std::vector<real>&>(static_cast<const data_vector<real>&>(*this).as_double_vector());
-    }
-    std::vector<std::string>& as_string_vector() {
-       return const_cast<std::vector<std::string>&>(static_cast<const data_vector<real>&>(*this).as_string_vector());
-    }
-    std::vector<bool>& as_bool_vector() {
-       return const_cast<std::vector<bool>&>(static_cast<const data_vector<real>&>(*this).as_bool_vector());
-    }
-    std::vector<int>& as_int_vector() {
-       return const_cast<std::vector<int>&>(static_cast<const data_vector<real>&>(*this).as_int_vector());
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+
+    void push_back(std::string_view s) {
+        chars.insert(chars.end(), s.begin(), s.end());
+        offsets.push_back(chars.size());
     }
 
-    void convert_back(const std::string& s) {
-        char* end;
-        switch(type) {
-        case DataType::D:
-            push_back(static_cast<int>(strtol(s.c_str(), &end, 10)));
-            break;
-        case DataType::LE:
-            push_back(strtod(s.c_str(), &end));
-            break;
-        case DataType::S:
-            push_back(s);
-            break;
-        }
+    /**
+     * @brief Replaces the `i`th string. Moves all following characters, so this is
+     * linear in the size of the column.
+     */
+    void replace(size_t i, std::string_view s) {
+        const offset_t begin = offsets[i];
+        const offset_t end = offsets[i + 1];
+        chars.erase(chars.begin() + begin, chars.begin() + end);
+        chars.insert(chars.begin() + begin, s.begin(), s.end());
+        for (size_t k = i + 1; k < offsets.size(); k++)
+            offsets[k] = offsets[k] - (end - begin) + s.size();
     }
 
-    size_t size() const {
-        switch(type) {
-        case DataType::D:
-            return const_cast<data_vector<real>*>(this)->as_int_vector().size();
-            break;
-        case DataType::LE:
-            return const_cast<data_vector<real>*>(this)->as_double_vector().size();
-            break;
-        case DataType::S:
-            return const_cast<data_vector<real>*>(this)->as_string_vector().size();
-            break;
+    /**
+     * @brief Replaces the strings from the `at`th on by the strings `[begin, end)` of `other`.
+     * Moves the characters after them once, however many strings are replaced.
+     */
+    void replace_range(size_t at, const string_column& other, size_t begin, size_t end) {
+        const size_t n = end - begin;
+        const offset_t old_begin = offsets[at];
+        const offset_t old_end = offsets[at + n];
+        const offset_t new_begin = other.offsets[begin];
+        const offset_t new_end = other.offsets[end];
+        if (old_end - old_begin == new_end - new_begin)
+            std::copy(other.chars.begin() + new_begin, other.chars.begin() + new_end, chars.begin() + old_begin);
+        else {
+            chars.erase(chars.begin() + old_begin, chars.begin() + old_end);
+            chars.insert(chars.begin() + old_begin, other.chars.begin() + new_begin, other.chars.begin() + new_end);
+            for (size_t k = at + n; k < offsets.size(); k++)
+                offsets[k] = offsets[k] - (old_end - old_begin) + (new_end - new_begin);
         }
-        return 0;
+        for (size_t k = 1; k < n; k++)
+            offsets[at + k] = old_begin + other.offsets[begin + k] - new_begin;
     }
 
-    const std::string& get_name() const {
-        return this->name;
+    /**
+     * @brief Reserves space for `n` strings with a total of `bytes` characters
+     */
+    void reserve(size_t n, size_t bytes = 0) {
+        offsets.reserve(n + 1);
+        chars.reserve(bytes);
     }
-    void set_name(const std::string& name) {
-        this->name = name;
+
+    void clear() {
+        chars.clear();
+        offsets.assign(1, 0);
     }
 
-    void print_at(size_t i, std::ostream& os) const {
-        switch(type) {
-        case DataType::D:
-            os << std::setw(FIELDWIDTH) << const_cast<data_vector<real>*>(this)->as_int_vector()[i] << " ";
-            break;
-        case DataType::LE:
-            os << std::setw(FIELDWIDTH) << const_cast<data_vector<real>*>(this)->as_double_vector()[i] << " ";
-            break;
-        case DataType::S:
-            os << std::setw(FIELDWIDTH) << const_cast<data_vector<real>*>(this)->as_string_vector()[i] << " ";
-            break;
+    /**
+     * @brief Calls `fn(i)` for every row `i` in `[first, last)` whose string contains `needle`
+     * (not empty), in ascending order. See `helper::find_substring` for `ignore_case`.
+     *
+     * Searches the character buffer in one go instead of string by string, matches that
+     * run over the end of a string are dropped.
+     */
+    template<typename F>
+    void for_each_containing(std::string_view needle, bool ignore_case, size_t first, size_t last, F&& fn) const {
+        const char* base = chars.data();
+        const char* p = base + offsets[first];
+        const char* end = base + offsets[last];
+        size_t row = first;
+        while (row < last) {
+            const char* hit = helper::find_substring(p, end, needle, ignore_case);
+            if (hit == end) return;
+            const offset_t at = hit - base;
+            // the string the match starts in
+            row = std::upper_bound(offsets.begin() + row + 1, offsets.begin() + last + 1, at) - offsets.begin() - 1;
+            if (at + needle.size() <= offsets[row + 1]) {
+                fn(row);
+                p = base + offsets[++row];
+            }
+            else
+                p = hit + 1;
         }
     }
 
-    void write_to_binary(std::ostream& file) const {
-        helper::write_string(file, name);
+    /**
+     * @brief The character buffer holding all strings back to back
+     */
+    const char* data() const { return chars.data(); }
 
-        file.write(reinterpret_cast<const char*>(&type), sizeof(DataType));
+    /**
+     * @brief Total number of characters
+     */
+    size_t byte_size() const { return chars.size(); }
 
-        size_t count = size();
-        file.write(reinterpret_cast<const char*>(&count), sizeof(size_t));
+    /**
+     * @brief Allocated bytes: the offsets count as payload, the characters as strings
+     */
+    memory_footprint memory_usage() const {
+        memory_footprint m;
+        m.payload = offsets.capacity() * sizeof(offset_t);
+        m.strings = chars.capacity();
+        return m;
+    }
 
-        switch (type) {
-        case DataType::LE:
-        {
-            for (auto& v : as_double_vector())
-                file.write(reinterpret_cast<const char*>(&v), sizeof(real));
-            break;
-        }
-        case DataType::S:
-            for (auto& s : as_string_vector())
-            {
-                helper::write_string(file, s);
-            }
-            break;
-        default:
-            throw std::runtime_error("not yet implemented");
-            break;
-        }
+    void shrink_to_fit() {
+        chars.shrink_to_fit();
+        offsets.shrink_to_fit();
     }
 
-    static void read_from_binary(std::istream& file, data_vector& vec) {
-        auto name = helper::read_string(file);
+    /**
+     * @brief The `size() + 1` offsets into `data()`
+     */
+    const column_storage<offset_t>& get_offsets() const { return offsets; }
+
+    /**
+     * @brief Writes the offsets and the character buffer in one go each
+     */
+    void write_to_binary(std::ostream& file) const {
+        size_t bytes = chars.size();
+        file.write(reinterpret_cast<const char*>(&bytes), sizeof(size_t));
+        file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(offset_t));
+        file.write(chars.data(), bytes);
+    }
+
+    /**
+     * @brief Reads `count` strings written by `write_to_binary`
+     */
+    void read_from_binary(std::istream& file, size_t count) {
+        size_t bytes;
+        file.read(reinterpret_cast<char*>(&bytes), sizeof(size_t));
+        offsets.resize(count + 1);
+        file.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(offset_t));
+        chars.resize(bytes);
+        file.read(chars.data(), bytes);
+        if (!file || offsets.front() != 0 || offsets.back() != bytes)
+            throw std::runtime_error("corrupt string column in binary file");
+    }
+
+private:
+    column_storage<char> chars;
+    column_storage<offset_t> offsets;
+};
+
+/**
+     * @brief Storage of a `%c` column.
+     *
+     * Real and imaginary parts are kept in two separate contiguous arrays (structure of arrays)
+     * instead of one array of `std::complex`, so that loops over a column, like computing the
+     * magnitudes, work on plain `real` arrays and can be vectorised.
+     *
+     * @tparam real
+     */
+template<typename real>
+class complex_column {
+public:
+    explicit complex_column(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : re(resource), im(resource) {}
+
+    size_t size() const { return re.size(); }
+    bool empty() const { return re.empty(); }
+
+    std::complex<real> operator[](size_t i) const {
+        return std::complex<real>(re[i], im[i]);
+    }
+
+    void push_back(const std::complex<real>& c) {
+        re.push_back(c.real());
+        im.push_back(c.imag());
+    }
+
+    void set(size_t i, const std::complex<real>& c) {
+        re[i] = c.real();
+        im[i] = c.imag();
+    }
+
+    void reserve(size_t n) {
+        re.reserve(n);
+        im.reserve(n);
+    }
+
+    void resize(size_t n) {
+        re.resize(n);
+        im.resize(n);
+    }
+
+    void clear() {
+        re.clear();
+        im.clear();
+    }
+
+    /**
+     * @brief Allocated bytes for both parts
+     */
+    size_t allocated_bytes() const { return (re.capacity() + im.capacity()) * sizeof(real); }
+
+    void shrink_to_fit() {
+        re.shrink_to_fit();
+        im.shrink_to_fit();
+    }
+
+    const column_storage<real>& real_part() const { return re; }
+    const column_storage<real>& imag_part() const { return im; }
+    column_storage<real>& real_part() { return re; }
+    column_storage<real>& imag_part() { return im; }
+
+    /**
+     * @brief The absolute values `|z|` of all elements
+     */
+    column_storage<real> magnitude() const {
+        column_storage<real> out(size());
+        for (size_t i = 0; i < out.size(); i++)
+            out[i] = std::sqrt(re[i] * re[i] + im[i] * im[i]);
+        return out;
+    }
+
+    /**
+     * @brief The arguments `arg(z)` of all elements, in radians
+     */
+    column_storage<real> phase() const {
+        column_storage<real> out(size());
+        for (size_t i = 0; i < out.size(); i++)
+            out[i] = std::atan2(im[i], re[i]);
+        return out;
+    }
+
+    /**
+     * @brief Writes all real parts, then all imaginary parts
+     */
+    void write_to_binary(std::ostream& file) const {
+        file.write(reinterpret_cast<const char*>(re.data()), re.size() * sizeof(real));
+        file.write(reinterpret_cast<const char*>(im.data()), im.size() * sizeof(real));
+    }
+
+    /**
+     * @brief Reads `count` elements written by `write_to_binary`
+     *
+     * @param real_size the size of the floating point numbers in the file
+     */
+    void read_from_binary(std::istream& file, size_t count, uint32_t real_size = sizeof(real)) {
+        resize(count);
+        helper::read_reals(file, count, real_size, re.data());
+        helper::read_reals(file, count, real_size, im.data());
+    }
+
+private:
+    column_storage<real> re;
+    column_storage<real> im;
+};
+
+/**
+     * @brief Summary of the valid values of a numeric column, see `data_vector::stats`
+     */
+struct column_stats {
+    size_t count = 0;
+    size_t nulls = 0;
+    double min = std::numeric_limits<double>::quiet_NaN();
+    double max = std::numeric_limits<double>::quiet_NaN();
+    double mean = std::numeric_limits<double>::quiet_NaN();
+};
+
+/**
+     * @brief TFS data column.
+     *
+     * Cells that are missing or couldn't be parsed are null. Which cells are valid is tracked
+     * in a bitmap that is only allocated once the first null is added, columns without nulls
+     * don't pay for it. Null cells hold a default value (`0`, `NaN`, `""` or `false`).
+     *
+     * @tparam real
+     */
+template <typename real>
+class data_vector {
+    typedef std::variant<
+        string_column,
+        column_storage<real>,
+        column_storage<int>,
+        bitmap,
+        complex_column<real>
+        > payload_t;
+    payload_t payload;
+    DataType type;
+    std::string name;
+    bitmap validity;
+
+    void mark_valid() {
+        if (!validity.empty()) validity.push_back(true);
+    }
+
+    void push_default() {
+        switch (type) {
+        case DataType::D:
+            as_int_vector().push_back(0);
+            break;
+        case DataType::LE:
+            as_double_vector().push_back(std::numeric_limits<real>::quiet_NaN());
+            break;
+        case DataType::S:
+            as_string_vector().push_back(std::string_view());
+            break;
+        case DataType::B:
+            as_bool_vector().push_back(false);
+            break;
+        case DataType::C:
+            as_complex_vector().push_back(std::complex<real>(std::numeric_limits<real>::quiet_NaN(),
+                                                             std::numeric_limits<real>::quiet_NaN()));
+            break;
+        }
+    }
+
+public:
+    static payload_t make_payload(DataType t, std::pmr::memory_resource* resource) {
+        switch(t) {
+        case DataType::B:
+            return payload_t(std::in_place_type<bitmap>, resource);
+        case DataType::LE:
+            return payload_t(std::in_place_type<column_storage<real>>, resource);
+        case DataType::D:
+            return payload_t(std::in_place_type<column_storage<int>>, resource);
+        case DataType::C:
+            return payload_t(std::in_place_type<complex_column<real>>, resource);
+        default:
+            return payload_t(std::in_place_type<string_column>, resource);
+        }
+    }
+
+public:
+    /**
+     * @brief Construct a new data vector object with the given datatype
+     *
+     * @param t
+     * @param s
+     * @param resource where the data is allocated from
+     */
+    data_vector(DataType t, const std::string& s,
+                std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : payload(make_payload(t, resource)), type(t), name(s), validity(resource) {}
+
+    /**
+     * @brief The memory resource the data is allocated from
+     */
+    std::pmr::memory_resource* get_resource() const { return validity.resource(); }
+
+    const column_storage<real>& as_double_vector() const {
+        return std::get<column_storage<real>>(payload);
+    }
+    const string_column& as_string_vector() const {
+        return std::get<string_column>(payload);
+    }
+    const bitmap& as_bool_vector() const {
+        return std::get<bitmap>(payload);
+    }
+    const column_storage<int>& as_int_vector() const {
+        return std::get<column_storage<int>>(payload);
+    }
+    const complex_column<real>& as_complex_vector() const {
+        return std::get<complex_column<real>>(payload);
+    }
+
+    column_storage<real>& as_double_vector() {
+       return const_cast<column_storage<real>&>(static_cast<const data_vector<real>&>(*this).as_double_vector());
+    }
+    string_column& as_string_vector() {
+       return const_cast<string_column&>(static_cast<const data_vector<real>&>(*this).as_string_vector());
+    }
+    bitmap& as_bool_vector() {
+       return const_cast<bitmap&>(static_cast<const data_vector<real>&>(*this).as_bool_vector());
+    }
+    column_storage<int>& as_int_vector() {
+       return const_cast<column_storage<int>&>(static_cast<const data_vector<real>&>(*this).as_int_vector());
+    }
+    complex_column<real>& as_complex_vector() {
+       return const_cast<complex_column<real>&>(static_cast<const data_vector<real>&>(*this).as_complex_vector());
+    }
+
+    /**
+     * @brief Parses `s` and appends it. Cells that can't be parsed are appended as null,
+     * as are `nan` numbers (that's how nulls are written, see `format_at`).
+     */
+    void convert_back(std::string_view s) {
+        switch(type) {
+        case DataType::D:
+        {
+            int i;
+            if (helper::parse_number(s, i)) push_back(i);
+            else push_null();
+            break;
+        }
+        case DataType::LE:
+        {
+            double d;
+            if (helper::parse_number(s, d) && !std::isnan(d)) push_back(d);
+            else push_null();
+            break;
+        }
+        case DataType::S:
+            push_back(s);
+            break;
+        case DataType::B:
+        {
+            bool b;
+            if (helper::parse_bool(s, b)) push_back(b);
+            else push_null();
+            break;
+        }
+        case DataType::C:
+        {
+            double re, im;
+            if (helper::parse_complex(s, re, im) && !std::isnan(re) && !std::isnan(im))
+                push_back(std::complex<double>(re, im));
+            else push_null();
+            break;
+        }
+        }
+    }
+
+    /**
+     * @brief Appends a null cell
+     */
+    void push_null() {
+        if (validity.empty())
+            validity.resize(size(), true);
+        push_default();
+        validity.push_back(false);
+    }
+
+    /**
+     * @brief The `i`th cell as `data_value`. Null cells give their default value.
+     */
+    data_value<real> value_at(size_t i) const {
+        switch (type) {
+        case DataType::D:
+            return data_value<real>(as_int_vector()[i]);
+        case DataType::LE:
+            return data_value<real>(static_cast<double>(as_double_vector()[i]));
+        case DataType::S:
+            return data_value<real>(std::string(as_string_vector()[i]));
+        case DataType::B:
+            return data_value<real>(static_cast<bool>(as_bool_vector()[i]));
+        case DataType::C:
+            return data_value<real>(std::complex<double>(as_complex_vector()[i]));
+        }
+        return data_value<real>();
+    }
+
+    /**
+     * @brief Overwrites the `i`th cell (which becomes valid). Throws `std::runtime_error`
+     * if `value` doesn't have the type of the column.
+     */
+    void set(size_t i, const data_value<real>& value) {
+        if (value.type != type)
+            throw std::runtime_error("type mismatch in column " + name);
+        switch (type) {
+        case DataType::D:
+            as_int_vector()[i] = value.get_int();
+            break;
+        case DataType::LE:
+            as_double_vector()[i] = value.get_double();
+            break;
+        case DataType::S:
+            as_string_vector().replace(i, value.get_string());
+            break;
+        case DataType::B:
+            as_bool_vector().set(i, value.get_bool());
+            break;
+        case DataType::C:
+            as_complex_vector().set(i, value.get_complex());
+            break;
+        }
+        if (!validity.empty())
+            validity.set(i);
+    }
+
+    /**
+     * @brief Makes the `i`th cell null
+     */
+    void set_null(size_t i) {
+        if (validity.empty())
+            validity.resize(size(), true);
+        validity.reset(i);
+    }
+
+    /**
+     * @brief Appends the rows `[begin, end)` of `other`, including their validity.
+     * `other` has to be of the same type.
+     */
+    void append(const data_vector& other, size_t begin, size_t end) {
+        if (other.type != type)
+            throw std::runtime_error("type mismatch in column " + name);
+        const size_t old_size = size();
+        switch (type) {
+        case DataType::D:
+        {
+            auto& v = other.as_int_vector();
+            as_int_vector().insert(as_int_vector().end(), v.begin() + begin, v.begin() + end);
+            break;
+        }
+        case DataType::LE:
+        {
+            auto& v = other.as_double_vector();
+            as_double_vector().insert(as_double_vector().end(), v.begin() + begin, v.begin() + end);
+            break;
+        }
+        case DataType::S:
+        {
+            auto& v = other.as_string_vector();
+            auto& offsets = v.get_offsets();
+            as_string_vector().reserve(old_size + end - begin, as_string_vector().byte_size() + offsets[end] - offsets[begin]);
+            for (size_t i = begin; i < end; i++)
+                as_string_vector().push_back(v[i]);
+            break;
+        }
+        case DataType::B:
+        {
+            auto& v = other.as_bool_vector();
+            for (size_t i = begin; i < end; i++)
+                as_bool_vector().push_back(v[i]);
+            break;
+        }
+        case DataType::C:
+        {
+            auto& v = other.as_complex_vector();
+            for (size_t i = begin; i < end; i++)
+                as_complex_vector().push_back(v[i]);
+            break;
+        }
+        }
+
+        if (other.validity.empty() && validity.empty())
+            return;
+        if (validity.empty())
+            validity.resize(old_size, true);
+        for (size_t i = begin; i < end; i++)
+            validity.push_back(other.is_valid(i));
+    }
+
+    /**
+     * @brief Overwrites the rows from `at` on with the rows `[begin, end)` of `other`, including
+     * their validity. `other` has to be of the same type.
+     */
+    void overwrite(size_t at, const data_vector& other, size_t begin, size_t end) {
+        if (other.type != type)
+            throw std::runtime_error("type mismatch in column " + name);
+        if (at + (end - begin) > size())
+            throw std::out_of_range("overwriting past the end of column " + name);
+        switch (type) {
+        case DataType::D:
+        {
+            auto& v = other.as_int_vector();
+            std::copy(v.begin() + begin, v.begin() + end, as_int_vector().begin() + at);
+            break;
+        }
+        case DataType::LE:
+        {
+            auto& v = other.as_double_vector();
+            std::copy(v.begin() + begin, v.begin() + end, as_double_vector().begin() + at);
+            break;
+        }
+        case DataType::S:
+            as_string_vector().replace_range(at, other.as_string_vector(), begin, end);
+            break;
+        case DataType::B:
+        {
+            auto& v = other.as_bool_vector();
+            for (size_t i = begin; i < end; i++)
+                as_bool_vector().set(at + i - begin, v[i]);
+            break;
+        }
+        case DataType::C:
+        {
+            auto& v = other.as_complex_vector();
+            for (size_t i = begin; i < end; i++)
+                as_complex_vector().set(at + i - begin, v[i]);
+            break;
+        }
+        }
+
+        if (other.validity.empty() && validity.empty())
+            return;
+        if (validity.empty())
+            validity.resize(size(), true);
+        for (size_t i = begin; i < end; i++)
+            validity.set(at + i - begin, other.is_valid(i));
+    }
+
+    /**
+     * @brief A copy of the rows `[begin, end)`, allocated from the same memory resource
+     */
+    data_vector slice(size_t begin, size_t end) const {
+        data_vector out(type, name, get_resource());
+        out.append(*this, begin, end);
+        return out;
+    }
+
+    /**
+     * @brief A copy of the rows in `rows`, which has to be a set out of `size()` rows
+     */
+    data_vector select_rows(const row_set& rows) const {
+        if (rows.size() != size())
+            throw std::runtime_error("row set doesn't fit column " + name);
+        data_vector out(type, name, get_resource());
+        out.reserve(rows.count());
+        if (type == DataType::S) {
+            // all at once, `append` would grow the characters run by run
+            auto& strings = as_string_vector();
+            size_t bytes = 0;
+            rows.for_each([&](size_t i) { bytes += strings[i].size(); });
+            out.as_string_vector().reserve(rows.count(), bytes);
+        }
+        // runs of consecutive rows are copied in one go
+        size_t begin = 0, end = 0;
+        rows.for_each([&](size_t i) {
+            if (i != end) {
+                out.append(*this, begin, end);
+                begin = i;
+            }
+            end = i + 1;
+        });
+        out.append(*this, begin, end);
+        return out;
+    }
+
+    /**
+     * @brief Whether the `i`th cell holds a value
+     */
+    bool is_valid(size_t i) const {
+        return validity.empty() || validity[i];
+    }
+
+    size_t null_count() const {
+        return validity.empty() ? 0 : validity.size() - validity.count();
+    }
+
+    /**
+     * @brief The validity bitmap, `nullptr` if the column has never had a null
+     */
+    const bitmap* validity_mask() const {
+        return validity.empty() ? nullptr : &validity;
+    }
+
+    /**
+     * @brief The `w`th word of the validity bitmap (bit `i` is row `w * 64 + i`)
+     */
+    bitmap::word_t validity_word(size_t w) const {
+        return validity.empty() ? ~bitmap::word_t(0) : validity.data()[w];
+    }
+
+    /**
+     * @brief The validity bitmap, with all bits set if the column has no nulls
+     */
+    bitmap valid_rows() const {
+        return validity.empty() ? bitmap(size(), true, get_resource()) : validity;
+    }
+
+    /**
+     * @brief Calls `fn(i)` for every valid row `i`, in ascending order
+     */
+    template<typename F>
+    void for_each_valid(F&& fn) const {
+        if (validity.empty()) {
+            const size_t n = size();
+            for (size_t i = 0; i < n; i++) fn(i);
+            return;
+        }
+        validity.for_each_set(fn);
+    }
+
+    /**
+     * @brief Memory allocated by the column. Counts capacity, not size, i.e. what is actually
+     * taken from the heap (or memory resource).
+     */
+    memory_footprint memory_usage() const {
+        memory_footprint m;
+        switch (type) {
+        case DataType::D:
+            m.payload = as_int_vector().capacity() * sizeof(int);
+            break;
+        case DataType::LE:
+            m.payload = as_double_vector().capacity() * sizeof(real);
+            break;
+        case DataType::S:
+            m = as_string_vector().memory_usage();
+            break;
+        case DataType::B:
+            m.payload = as_bool_vector().allocated_bytes();
+            break;
+        case DataType::C:
+            m.payload = as_complex_vector().allocated_bytes();
+            break;
+        }
+        m.index = sizeof(*this) + validity.allocated_bytes() + name.capacity();
+        return m;
+    }
+
+    /**
+     * @brief Gives back the memory that has been reserved for growing
+     */
+    void shrink_to_fit() {
+        switch (type) {
+        case DataType::D:
+            as_int_vector().shrink_to_fit();
+            break;
+        case DataType::LE:
+            as_double_vector().shrink_to_fit();
+            break;
+        case DataType::S:
+            as_string_vector().shrink_to_fit();
+            break;
+        case DataType::B:
+            as_bool_vector().shrink_to_fit();
+            break;
+        case DataType::C:
+            as_complex_vector().shrink_to_fit();
+            break;
+        }
+        validity.shrink_to_fit();
+    }
+
+    /**
+     * @brief Count, minimum, maximum and mean of the valid values.
+     * Only `count` and `nulls` are filled in for non-numeric columns, complex columns use the magnitude.
+     */
+    column_stats stats() const {
+        column_stats s;
+        s.nulls = null_count();
+        s.count = size() - s.nulls;
+
+        auto accumulate = [&](auto&& value_at) {
+            if (s.count == 0) return;
+            double sum = 0.0;
+            double min = std::numeric_limits<double>::infinity();
+            double max = -min;
+            for_each_valid([&](size_t i) {
+                double v = value_at(i);
+                sum += v;
+                if (v < min) min = v;
+                if (v > max) max = v;
+            });
+            s.min = min;
+            s.max = max;
+            s.mean = sum / s.count;
+        };
+
+        switch (type) {
+        case DataType::D:
+        {
+            auto& v = as_int_vector();
+            accumulate([&](size_t i) { return static_cast<double>(v[i]); });
+            break;
+        }
+        case DataType::LE:
+        {
+            auto& v = as_double_vector();
+            accumulate([&](size_t i) { return static_cast<double>(v[i]); });
+            break;
+        }
+        case DataType::C:
+        {
+            auto& v = as_complex_vector();
+            accumulate([&](size_t i) { return static_cast<double>(std::abs(v[i])); });
+            break;
+        }
+        default:
+            break;
+        }
+        return s;
+    }
+
+    size_t size() const {
+        switch(type) {
+        case DataType::D:
+            return const_cast<data_vector<real>*>(this)->as_int_vector().size();
+            break;
+        case DataType::LE:
+            return const_cast<data_vector<real>*>(this)->as_double_vector().size();
+            break;
+        case DataType::S:
+            return const_cast<data_vector<real>*>(this)->as_string_vector().size();
+            break;
+        case DataType::B:
+            return as_bool_vector().size();
+        case DataType::C:
+            return as_complex_vector().size();
+        }
+        return 0;
+    }
+
+    const std::string& get_name() const {
+        return this->name;
+    }
+    void set_name(const std::string& name) {
+        this->name = name;
+    }
+
+    void print_at(size_t i, std::ostream& os) const {
+        switch(type) {
+        case DataType::D:
+            os << std::setw(FIELDWIDTH) << const_cast<data_vector<real>*>(this)->as_int_vector()[i] << " ";
+            break;
+        case DataType::LE:
+            os << std::setw(FIELDWIDTH) << const_cast<data_vector<real>*>(this)->as_double_vector()[i] << " ";
+            break;
+        case DataType::S:
+            os << std::setw(FIELDWIDTH) << const_cast<data_vector<real>*>(this)->as_string_vector()[i] << " ";
+            break;
+        }
+    }
+
+    /**
+     * @brief Appends the `i`th element to `out`, formatted for a TFS file.
+     *
+     * @param i the row
+     * @param out the output buffer
+     * @param width the field width, see `helper::field_width`
+     *
+     * Null cells are written as `nan` (`""` in string columns), which reads back as null.
+     */
+    void format_at(size_t i, std::string& out, int width) const {
+        if (!is_valid(i)) {
+            helper::append_field(out, type == DataType::S ? "\"\"" : "nan", width, type == DataType::S);
+            return;
+        }
+        switch(type) {
+        case DataType::D:
+            helper::append_number(out, as_int_vector()[i], width);
+            break;
+        case DataType::LE:
+            helper::append_number(out, as_double_vector()[i], width);
+            break;
+        case DataType::S:
+            helper::append_string(out, as_string_vector()[i], width);
+            break;
+        case DataType::B:
+            helper::append_field(out, as_bool_vector()[i] ? "true" : "false", width, false);
+            break;
+        case DataType::C:
+            helper::append_complex(out, as_complex_vector()[i], width);
+            break;
+        default:
+            throw std::runtime_error("not yet implemented");
+        }
+    }
+
+    void write_to_binary(std::ostream& file) const {
+        helper::write_string(file, name);
+
+        file.write(reinterpret_cast<const char*>(&type), sizeof(DataType));
+
+        size_t count = size();
+        file.write(reinterpret_cast<const char*>(&count), sizeof(size_t));
+
+        switch (type) {
+        case DataType::LE:
+        {
+            auto& v = as_double_vector();
+            file.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(real));
+            break;
+        }
+        case DataType::D:
+        {
+            auto& v = as_int_vector();
+            file.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(int));
+            break;
+        }
+        case DataType::S:
+            as_string_vector().write_to_binary(file);
+            break;
+        case DataType::B:
+            as_bool_vector().write_to_binary(file);
+            break;
+        case DataType::C:
+            as_complex_vector().write_to_binary(file);
+            break;
+        default:
+            throw std::runtime_error("not yet implemented");
+            break;
+        }
+
+        char has_validity = validity.empty() ? 0 : 1;
+        file.write(&has_validity, 1);
+        if (has_validity)
+            validity.write_to_binary(file);
+    }
+
+    /**
+     * @brief Reads a column written by `write_to_binary`
+     *
+     * @param file
+     * @param vec the column to read into, gets overwritten
+     * @param version the version of the binary file, see `BINARY_VERSION`
+     * @param real_size the size of the floating point numbers in the file
+     */
+    static void read_from_binary(std::istream& file, data_vector& vec,
+                                 uint32_t version = BINARY_VERSION, uint32_t real_size = sizeof(real)) {
+        auto name = helper::read_string(file);
 
         DataType t;
         file.read(reinterpret_cast<char*>(&t), sizeof(DataType));
@@ -402,24 +1624,31 @@ public:
         size_t count;
         file.read(reinterpret_cast<char*>(&count), sizeof(size_t));
 
-        vec.name = name;
-        vec.type = t;
+        vec = data_vector(t, name, vec.get_resource());
 
         switch (t) {
         case DataType::LE:
         {
             auto& v = vec.as_double_vector();
-            v.reserve(count);
-            for (size_t i = 0; i < count; i++) {
-                real r;
-                file.read(reinterpret_cast<char*>(&r), sizeof(real));
-                v.push_back(r);
-            }
+            v.resize(count);
+            helper::read_reals(file, count, real_size, v.data());
+            break;
+        }
+        case DataType::D:
+        {
+            auto& v = vec.as_int_vector();
+            v.resize(count);
+            file.read(reinterpret_cast<char*>(v.data()), count * sizeof(int));
             break;
         }
         case DataType::S:
         {
             auto& v = vec.as_string_vector();
+            if (version >= 1) {
+                v.read_from_binary(file, count);
+                break;
+            }
+            // version 0 stored every string with its own length
             v.reserve(count);
             for (size_t i = 0; i < count; i++) {
                 auto s = helper::read_string(file);
@@ -427,10 +1656,23 @@ public:
             }
             break;
         }
+        case DataType::B:
+            vec.as_bool_vector().read_from_binary(file, count);
+            break;
+        case DataType::C:
+            vec.as_complex_vector().read_from_binary(file, count, real_size);
+            break;
         default:
             throw std::runtime_error("not implemented");
         }
 
+        if (version >= 3) {
+            char has_validity;
+            file.read(&has_validity, 1);
+            if (has_validity)
+                vec.validity.read_from_binary(file, count);
+        }
+
     }
 
     void reserve(size_t n) {
@@ -447,6 +1689,9 @@ public:
         case DataType::S:
             as_string_vector().reserve(n);
             break;
+        case DataType::C:
+            as_complex_vector().reserve(n);
+            break;
         }
     }
 
@@ -455,100 +1700,363 @@ public:
     void push_back(bool b) {
         if (type != DataType::B) throw std::runtime_error("this is not a bool vector");
         as_bool_vector().push_back(b);
+        mark_valid();
     }
     void push_back(int i) {
         if (type != DataType::D) throw std::runtime_error("this is not an int vector");
         as_int_vector().push_back(i);
+        mark_valid();
     }
     void push_back(double d) {
         if (type != DataType::LE) throw std::runtime_error("this is not a double vector");
         as_double_vector().push_back(static_cast<real>(d));
+        mark_valid();
     }
     void push_back(float d) {
         push_back(static_cast<double>(d));
     }
-    void push_back(const std::string& s) {
+    void push_back(const std::complex<double>& c) {
+        if (type != DataType::C) throw std::runtime_error("this is not a complex vector");
+        as_complex_vector().push_back(std::complex<real>(c));
+        mark_valid();
+    }
+    void push_back(std::string_view s) {
         if (type != DataType::S) throw std::runtime_error("this is not a string vector");
         as_string_vector().push_back(s);
+        mark_valid();
+    }
+    void push_back(const std::string& s) {
+        push_back(std::string_view(s));
+    }
+    void push_back(const char* s) {
+        push_back(std::string_view(s));
+    }
+};
+inline DataType DT_from_string(const std::string& token) {
+    if (token == "%d") return DataType::D;
+    if (token == "%le") return DataType::LE;
+    if (token == "%b") return DataType::B;
+    if (token == "%c") return DataType::C;
+    return DataType::S; // ddefault to S is safe
+}
+inline const char* string_fromDT(DataType t)
+{
+    switch (t)
+    {
+    case DataType::D:
+        return "%d";
+    case DataType::LE:
+        return "%le";
+    case DataType::B:
+        return "%b";
+    case DataType::C:
+        return "%c";
+    default:
+        return "%s";
+    }
+}
+
+template <typename real>
+std::ostream& operator<<(std::ostream& os, const data_value<real>& v)
+{
+    return os << v.pretty_print();
+}
+
+namespace helper {
+/**
+         * @brief Appends a property value to `out`, formatted for a TFS header.
+         */
+template <typename real>
+void append_value(std::string& out, const data_value<real>& v)
+{
+    switch (v.type)
+    {
+    case DataType::D:
+        append_number(out, v.get_int(), 0);
+        break;
+    case DataType::LE:
+        append_number(out, v.get_double(), 0);
+        break;
+    case DataType::S:
+        append_string(out, v.get_string(), 0);
+        break;
+    case DataType::B:
+        out += v.get_bool() ? "true" : "false";
+        break;
+    case DataType::C:
+        append_complex(out, v.get_complex(), 0);
+        break;
+    default:
+        out += v.pretty_print();
+    }
+}
+
+/**
+         * @brief Appends a property line (`@ NAME %type value`) to `out`.
+         */
+template <typename real>
+void append_property(std::string& out, const data_property<real>& p)
+{
+    out += "@ ";
+    append_field(out, p.name, WRITE_PROPERTYWIDTH, true);
+    out += ' ';
+    append_field(out, string_fromDT(p.value.type), 4, true);
+    out += ' ';
+    append_value(out, p.value);
+    out += '\n';
+}
+
+/**
+         * @brief Appends the column names (`* ...`) and column types (`$ ...`) lines to `out`.
+         * The fields are aligned like the data fields, i.e. names of string columns are left aligned.
+         *
+         * @param names the column names
+         * @param types the column types
+         * @param widths the field widths
+         */
+inline void append_column_header(std::string& out,
+                                 const std::vector<std::string>& names,
+                                 const std::vector<DataType>& types,
+                                 const std::vector<int>& widths)
+{
+    out += "* ";
+    for (size_t c = 0; c < names.size(); c++) {
+        if (c > 0) out += ' ';
+        append_field(out, names[c], widths[c], types[c] == DataType::S);
+    }
+    out += "\n$ ";
+    for (size_t c = 0; c < types.size(); c++) {
+        if (c > 0) out += ' ';
+        append_field(out, string_fromDT(types[c]), widths[c], types[c] == DataType::S);
+    }
+    out += '\n';
+}
+
+/**
+     * @brief Open addressing hash index from names to positions in a container.
+     *
+     * Only hashes and positions are stored, the names themselves are looked up in the owning
+     * container (through `name_at(position)`), which also keeps the insertion order.
+     * Lookups never insert.
+     */
+class flat_index {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    /**
+     * @brief Returns the position of `name`, or `npos` if it isn't in the index
+     *
+     * @param name
+     * @param name_at returns the name stored at a given position
+     */
+    template<typename NameAt>
+    size_t find(std::string_view name, NameAt&& name_at) const {
+        if (slots.empty()) return npos;
+        const uint64_t h = hash(name);
+        for (size_t i = h & mask();; i = (i + 1) & mask()) {
+            const slot& sl = slots[i];
+            if (sl.position == npos) return npos;
+            if (sl.hash == h && std::string_view(name_at(sl.position)) == name) return sl.position;
+        }
+    }
+
+    /**
+     * @brief Adds `name` at `position`. If `name` is already in the index, its position is replaced.
+     */
+    template<typename NameAt>
+    void insert(std::string_view name, size_t position, NameAt&& name_at) {
+        if (2 * (count + 1) > slots.size())
+            grow();
+        const uint64_t h = hash(name);
+        for (size_t i = h & mask();; i = (i + 1) & mask()) {
+            slot& sl = slots[i];
+            if (sl.position == npos) {
+                sl = slot{h, position};
+                count++;
+                return;
+            }
+            if (sl.hash == h && std::string_view(name_at(sl.position)) == name) {
+                sl.position = position;
+                return;
+            }
+        }
+    }
+
+    void clear() {
+        slots.clear();
+        count = 0;
     }
-};
-inline DataType DT_from_string(const std::string& token) {
-    if (token == "%d") return DataType::D;
-    if (token == "%le") return DataType::LE;
-    if (token == "%b") return DataType::B;
-    return DataType::S; // ddefault to S is safe
-}
-inline const char* string_fromDT(DataType t)
-{
-    switch (t)
-    {
-    case DataType::D:
-        return "%d";
-    case DataType::LE:
-        return "%le";
-    default:
-        return "%s";
+
+    size_t size() const { return count; }
+
+    /**
+     * @brief Bytes allocated for the slots
+     */
+    size_t memory_usage() const { return slots.capacity() * sizeof(slot); }
+
+private:
+    struct slot {
+        uint64_t hash;
+        size_t position;
+    };
+    std::vector<slot> slots;
+    size_t count = 0;
+
+    static uint64_t hash(std::string_view name) {
+        // FNV-1a, names are short
+        uint64_t h = 14695981039346656037ull;
+        for (char c : name) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 1099511628211ull;
+        }
+        return h;
     }
-}
 
-template <typename real>
-std::ostream& operator<<(std::ostream& os, const data_value<real>& v)
-{
-    return os << v.pretty_print();
+    size_t mask() const { return slots.size() - 1; }
+
+    void grow() {
+        std::vector<slot> old(std::max<size_t>(16, 2 * slots.size()), slot{0, npos});
+        old.swap(slots);
+        for (const slot& sl : old) {
+            if (sl.position == npos) continue;
+            size_t i = sl.hash & mask();
+            while (slots[i].position != npos)
+                i = (i + 1) & mask();
+            slots[i] = sl;
+        }
+    }
+};
 }
 
 /**
      * @brief a TFS dataframe. Contains a list of properties and a collection of data columns.
      *
+     * Columns are held by `std::shared_ptr<const data_vector>`, so copying a dataframe doesn't
+     * copy any data: the copy shares the columns with the original. A column is only cloned when
+     * it is changed through one of the non-const accessors while it is shared (copy on write).
+     * A `std::shared_ptr<const dataframe>` is therefore an immutable snapshot that can be read
+     * from any number of threads, while the owner of another copy keeps editing.
+     *
      * @tparam real
      */
 template<typename real=double>
 class dataframe
 {
-    std::vector<data_vector<real>> columns;
-    std::map<std::string, size_t> column_headers;
-    // map would be nice but we  also need to access by index
-    //std::map<std::string, data_value<real>> properties;
+    // columns and properties are kept in file order, the indices map names to positions
+    std::vector<std::shared_ptr<const data_vector<real>>> columns;
+    helper::flat_index column_index;
     std::vector<data_property<real>> properties;
-    std::map<std::string, size_t> idx;
+    helper::flat_index property_index;
+    // column names while parsing the header, until the column types are known
+    std::vector<std::string> header_names;
+    // rows by the value of the column given when loading (see `get_index`). `row_keys` is that
+    // column as it was indexed, kept even if the column is replaced later
+    helper::flat_index row_index;
+    std::shared_ptr<const data_vector<real>> row_keys;
     bool ini_complete = false;
+    std::pmr::memory_resource* resource;
 
 public:
-    dataframe(){};
-    /// <summary>
-    ///
-    /// </summary>
-    /// <param name="path"></param>
-    /// <param name="index"></param>
-    explicit dataframe(const std::string &path, const std::string& index = "");
+    typedef real value_type;
+
+    /**
+     * @brief An empty dataframe. Columns will be allocated from `resource`.
+     */
+    explicit dataframe(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : resource(resource) {}
+
+    /**
+     * @brief Loads a TFS file.
+     *
+     * @param path
+     * @param index name of a string column to index (see `get_index`), or empty
+     * @param resource where the columns are allocated from. Has to outlive the columns, which may
+     *  be shared beyond the lifetime of the dataframe. Temporary parsing buffers never touch it,
+     *  they come from an arena on the stack that is reset after every line
+     */
+    explicit dataframe(const std::string &path, const std::string& index = "",
+                       std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /**
+     * @brief The memory resource new columns are allocated from
+     */
+    std::pmr::memory_resource* get_resource() const { return resource; }
 
+    /**
+     * @brief Returns the column `name`. Throws `std::runtime_error` if there is no such column.
+     * The non-const overload clones a shared column first, like `mutable_column`.
+     */
     data_vector<real> &get_column(const std::string &name);
     const data_vector<real> &get_column(const std::string &name) const;
-    const data_vector<real> &get_column(size_t index) const { return columns.at(index);}
+    const data_vector<real> &get_column(size_t index) const { return *columns.at(index);}
+
+    /**
+     * @brief Returns the column `name`, or `nullptr` if there is no such column.
+     */
+    const data_vector<real>* find_column(std::string_view name) const {
+        size_t i = column_position(name);
+        return i == helper::flat_index::npos ? nullptr : columns[i].get();
+    }
+    data_vector<real>* find_column(std::string_view name) {
+        size_t i = column_position(name);
+        return i == helper::flat_index::npos ? nullptr : &mutable_column(i);
+    }
+
+    /**
+     * @brief Shares the column at `index`. The column stays alive (and unchanged) as long
+     * as the returned pointer, whatever happens to this dataframe.
+     */
+    std::shared_ptr<const data_vector<real>> share_column(size_t index) const { return columns.at(index); }
+
+    /**
+     * @brief Replaces the column at `index` by `column` (without copying it).
+     * `column` has to have the same number of rows as the other columns.
+     */
+    void set_column(size_t index, std::shared_ptr<const data_vector<real>> column) {
+        if (columns.size() > 1 && column->size() != size())
+            throw std::runtime_error("column " + column->get_name() + " has the wrong length");
+        columns.at(index) = std::move(column);
+        rebuild_column_index();
+    }
+
+    /**
+     * @brief The column at `index`, for changing it. Clones the column first if it is shared
+     * with another dataframe (or someone holding it through `share_column`).
+     */
+    data_vector<real>& mutable_column(size_t index) {
+        auto& column = columns.at(index);
+        if (column.use_count() > 1)
+            column = std::make_shared<data_vector<real>>(column->slice(0, column->size()));
+        // the columns are always allocated non-const, see push_column
+        return const_cast<data_vector<real>&>(*column);
+    }
+
+    bool has_column(std::string_view name) const { return find_column(name) != nullptr; }
 
     void reserve_columns(size_t n) { columns.reserve(n); }
     void reserve_rows(size_t n) {
-        for (auto& col : columns) {
-            col.reserve(n);
+        for (size_t i = 0; i < columns.size(); i++) {
+            mutable_column(i).reserve(n);
         }
     }
 
     /**
      * @brief Moves a columns into the dataframe
+     * (if `vec` has been allocated from `get_resource()`, it's copied otherwise)
      *
      * @param vec
      * @param name
      */
-    void add_column(std::vector<real>&& vec, const std::string& name) {
-        column_headers[name] = columns.size();
-        data_vector<real> v(DataType::LE, name);
-        v.payload.double_vector = std::move(vec);
-        columns.push_back(std::move(v));
+    void add_column(column_storage<real>&& vec, const std::string& name) {
+        data_vector<real> v(DataType::LE, name, resource);
+        v.as_double_vector() = std::move(vec);
+        push_column(std::move(v));
     }
 
     void add_column(const data_vector<real>& vec, const std::string& name) {
-        column_headers[name] = columns.size();
-        columns.push_back(vec);
+        data_vector<real> v(vec.get_type(), name, resource);
+        v.append(vec, 0, vec.size());
+        push_column(std::move(v));
     }
 
     /**
@@ -558,17 +2066,17 @@ public:
      * @param name
      */
     void add_column(const std::vector<double>& vec, const std::string& name) {
-        column_headers[name] = columns.size();
-        data_vector<real> v(DataType::LE, name);
-        v.payload.double_vector = vec;
-        columns.push_back(std::move(v));
+        data_vector<real> v(DataType::LE, name, resource);
+        v.as_double_vector().assign(vec.begin(), vec.end());
+        push_column(std::move(v));
     }
 
     void add_column(const std::vector<std::string>& vec, const std::string& name) {
-        column_headers[name] = columns.size();
-        data_vector<real> v(DataType::S, name);
-        v.payload.string_vector = vec;
-        columns.push_back(std::move(v));
+        data_vector<real> v(DataType::S, name, resource);
+        v.reserve(vec.size());
+        for (auto& str : vec)
+            v.push_back(str);
+        push_column(std::move(v));
     }
 
     /**
@@ -579,26 +2087,46 @@ public:
      * @return data_vector<real>&
      */
     data_vector<real>& add_column(const std::string& name, DataType t) {
-        std::cout << "new column " << name << "\n";
-        column_headers[name] = columns.size();
-        columns.emplace_back(t, name);
-
-        return columns.back();
+        push_column(data_vector<real>(t, name, resource));
+        return mutable_column(columns.size() - 1);
     }
 
-    //data_value<real>& get_property(const std::string& key) { return properties[key];}
+    /**
+     * @brief Returns the property `key`. Throws `std::runtime_error` if there is no such property.
+     */
     data_property<real>& get_property(const std::string& key) {
-        for (auto& p : properties)
-            if (p.name == key) return p;
-        throw std::runtime_error("couldn't find key");
-        return properties[0];
+        auto p = find_property(key);
+        if (!p) throw std::runtime_error("couldn't find key " + key);
+        return *p;
+    }
+    const data_property<real>& get_property(const std::string& key) const {
+        auto p = find_property(key);
+        if (!p) throw std::runtime_error("couldn't find key " + key);
+        return *p;
     }
     data_property<real>& get_property(size_t index) {
         return properties[index];
     }
+    const data_property<real>& get_property(size_t index) const {
+        return properties[index];
+    }
+
+    /**
+     * @brief Returns the property `key`, or `nullptr` if there is no such property.
+     */
+    const data_property<real>* find_property(std::string_view key) const {
+        size_t i = property_index.find(key, [this](size_t p) -> const std::string& { return properties[p].name; });
+        return i == helper::flat_index::npos ? nullptr : &properties[i];
+    }
+    data_property<real>* find_property(std::string_view key) {
+        return const_cast<data_property<real>*>(static_cast<const dataframe<real>&>(*this).find_property(key));
+    }
+
+    bool has_property(std::string_view key) const { return find_property(key) != nullptr; }
 
     void add_property(const std::string& name, const data_value<real> value) {
         properties.push_back(data_property(name, value));
+        property_index.insert(name, properties.size() - 1, [this](size_t p) -> const std::string& { return properties[p].name; });
     }
 
     size_t property_count() const {
@@ -609,26 +2137,60 @@ public:
 
     void verify() const;
 
+    /**
+     * @brief Memory allocated by the dataframe. Columns shared with other dataframes
+     * are counted in full.
+     */
+    memory_footprint memory_usage() const;
+
+    /**
+     * @brief Memory allocated by the column at `index`
+     */
+    memory_footprint column_memory_usage(size_t index) const { return columns.at(index)->memory_usage(); }
+
+    /**
+     * @brief Estimates the memory a file will need once loaded (without loading it).
+     * Text files are estimated from the column types and the first rows, binary files
+     * from their size. Returns 0 if the file can't be read.
+     */
+    static size_t estimate_memory_usage(const std::string& path);
+
     size_t size() const
     {
         if (columns.size() == 0)
             return 0;
-        return columns[(*column_headers.begin()).second].size();
+        return columns[0]->size();
     }
 
     size_t column_count() const {
         return columns.size();
     }
 
+    /**
+     * @brief A dataframe with the properties and the rows in `rows` of this one.
+     * `rows` has to be a set out of `size()` rows.
+     */
+    dataframe select_rows(const row_set& rows) const {
+        dataframe out(resource);
+        for (auto& p : properties)
+            out.add_property(p.name, p.value);
+        out.reserve_columns(columns.size());
+        for (auto& c : columns)
+            out.push_column(c->select_rows(rows));
+        return out;
+    }
+
 
     /**
      * @brief Writes the dataframe to a file in tfs format.
+     * Columns are written in their original order. See `writer` for the details.
+     * Throws `std::runtime_error` if the file can't be opened.
      *
      * @param fname
      */
-    void to_file(const std::string& fname);
+    void to_file(const std::string& fname) const;
 
-    void to_binary_file(const std::string& fname);
+    void to_binary_file(const std::string& fname) const;
     static dataframe<real> from_binary_file(const std::string& fname);
     void load_from_binary_file(const std::string& fname);
 
@@ -638,22 +2200,375 @@ public:
 
 
     /**
-     * @brief Get the index of the given key
+     * @brief The row whose value in the index column (given when loading) is `key`, the first
+     * one if there are several. Throws `std::runtime_error` if there is no such row.
      *
-     * @param key
+     * @param key the cell as stored, with the quotes of TFS strings
      * @return size_t
      */
-    size_t get_index(const std::string& key) { return idx[key]; }
+    size_t get_index(std::string_view key) const {
+        const size_t row = row_keys
+                ? row_index.find(key, [&](size_t i) { return row_keys->as_string_vector()[i]; })
+                : helper::flat_index::npos;
+        if (row == helper::flat_index::npos)
+            throw std::runtime_error("no row with key " + std::string(key));
+        return row;
+    }
 
 private:
+    void push_column(data_vector<real>&& column) {
+        columns.push_back(std::make_shared<data_vector<real>>(std::move(column)));
+        index_column(columns.size() - 1);
+    }
+    void index_column(size_t i) {
+        column_index.insert(columns[i]->get_name(), i, [this](size_t p) -> const std::string& { return columns[p]->get_name(); });
+    }
+    void rebuild_column_index() {
+        column_index.clear();
+        for (size_t i = 0; i < columns.size(); i++)
+            index_column(i);
+    }
+    size_t column_position(std::string_view name) const {
+        return column_index.find(name, [this](size_t p) -> const std::string& { return columns[p]->get_name(); });
+    }
+
     void read_property(const std::string& line);
     void read_column_headers(const std::string& line);
     void read_column_types(const std::string& line);
-    void read_line(const std::string& line);
+    void read_line(const std::string& line, std::pmr::memory_resource* scratch);
     void check_ini();
 };
 
 
+/**
+     * @brief Writes a TFS file incrementally.
+     *
+     * Takes the properties and the column schema first, then accepts rows (`write_row`) or
+     * column batches (`write_columns`). Output is collected in a buffer of fixed size and
+     * flushed whenever it is full, so memory usage doesn't grow with the number of rows.
+     * The output is the same as `dataframe::to_file` (which uses this class).
+     *
+     * Example:
+     * ```
+     * tfs::writer<double> w("out.tfs");
+     * w.add_property("TYPE", "TWISS");
+     * w.add_column("NAME", tfs::DataType::S);
+     * w.add_column("S", tfs::DataType::LE);
+     * w.write_row("IP1", 0.0);
+     * w.close();
+     * ```
+     *
+     * Errors (type mismatches, wrong number of cells, adding columns after the first row)
+     * throw `std::runtime_error`.
+     *
+     * @tparam real
+     */
+template<typename real=double>
+class writer
+{
+    std::unique_ptr<std::ofstream> owned_stream;
+    std::ostream* stream;
+    std::vector<data_property<real>> properties;
+    std::vector<std::string> names;
+    std::vector<DataType> types;
+    std::vector<int> widths;
+    std::string buffer;
+    size_t buffer_size;
+    size_t current_cell = 0;
+    // where the row being written starts in `buffer`
+    size_t row_start = 0;
+    size_t rows = 0;
+    bool header_written = false;
+
+public:
+    /**
+     * @brief Opens `fname` for writing. Throws `std::runtime_error` if that fails.
+     *
+     * @param fname
+     * @param buffer_size the output is flushed whenever the buffer exceeds this size
+     */
+    explicit writer(const std::string& fname, size_t buffer_size = 1 << 22)
+        : owned_stream(new std::ofstream(fname, std::ios::binary | std::ios::trunc))
+        , stream(owned_stream.get())
+        , buffer_size(buffer_size)
+    {
+        if (!owned_stream->is_open())
+            throw std::runtime_error("couldn't open file " + fname + " for writing");
+        buffer.reserve(buffer_size);
+    }
+
+    /**
+     * @brief Writes to an already opened stream.
+     *
+     * @param os the stream, has to outlive the writer
+     * @param buffer_size the output is flushed whenever the buffer exceeds this size
+     */
+    explicit writer(std::ostream& os, size_t buffer_size = 1 << 22)
+        : stream(&os)
+        , buffer_size(buffer_size)
+    {
+        buffer.reserve(buffer_size);
+    }
+
+    writer(const writer&) = delete;
+    writer& operator=(const writer&) = delete;
+
+    ~writer() {
+        try {
+            close();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "tfs::writer: " << e.what() << "\n";
+        }
+    }
+
+    void add_property(const std::string& name, const data_value<real>& value) {
+        if (header_written) throw std::runtime_error("header has already been written");
+        properties.push_back(data_property<real>(name, value));
+    }
+
+    void add_column(const std::string& name, DataType t) {
+        if (header_written) throw std::runtime_error("header has already been written");
+        names.push_back(name);
+        types.push_back(t);
+        widths.push_back(helper::field_width(name));
+    }
+
+    size_t column_count() const { return names.size(); }
+
+    /**
+     * @brief Number of rows written so far
+     */
+    size_t row_count() const { return rows; }
+
+    /**
+     * @brief Writes one row. Takes one value per column, in column order.
+     * Accepts numbers, strings, `bool`s and `data_value`s: `%d` columns take integers, `%le` columns
+     * integers and floating point numbers, `%b` columns only `bool`s.
+     * Throws `std::runtime_error` (and writes nothing) if a value doesn't fit its column.
+     */
+    template<typename... Ts>
+    void write_row(const Ts&... values) {
+        check_open();
+        if (sizeof...(Ts) != names.size())
+            throw std::runtime_error("wrong number of cells in row");
+        begin_row();
+        try {
+            (append_cell(values), ...);
+        }
+        catch (...) {
+            discard_row();
+            throw;
+        }
+        end_row();
+    }
+
+    /**
+     * @brief Writes one row, given as a vector of `data_value`s.
+     */
+    void write_row(const std::vector<data_value<real>>& values) {
+        check_open();
+        if (values.size() != names.size())
+            throw std::runtime_error("wrong number of cells in row");
+        begin_row();
+        try {
+            for (auto& v : values)
+                append_cell(v);
+        }
+        catch (...) {
+            discard_row();
+            throw;
+        }
+        end_row();
+    }
+
+    /**
+     * @brief Writes a batch of rows, given as one `data_vector` per column.
+     * Blocks of `WRITE_BLOCKSIZE` rows are formatted in parallel and written in order.
+     *
+     * @param batch the columns, in column order and all of the same length
+     */
+    void write_columns(const std::vector<const data_vector<real>*>& batch) {
+        check_open();
+        if (batch.size() != names.size())
+            throw std::runtime_error("wrong number of columns in batch");
+        const size_t count = batch.empty() ? 0 : batch[0]->size();
+        for (size_t c = 0; c < batch.size(); c++) {
+            if (batch[c]->get_type() != types[c])
+                throw std::runtime_error("type mismatch in column " + names[c]);
+            if (batch[c]->size() != count)
+                throw std::runtime_error("columns in batch have different lengths");
+        }
+        write_header();
+
+        // format a couple of blocks per thread in parallel, then write them in order
+        const size_t blocks = (count + WRITE_BLOCKSIZE - 1) / WRITE_BLOCKSIZE;
+        std::vector<std::string> block_buffers(std::min(blocks, 2 * helper::thread_count()));
+
+        for (size_t first = 0; first < blocks; first += block_buffers.size()) {
+            const size_t n = std::min(block_buffers.size(), blocks - first);
+            helper::parallel_for(n, [&](size_t b) {
+                const size_t begin = (first + b) * WRITE_BLOCKSIZE;
+                block_buffers[b].clear();
+                format_rows(batch, begin, std::min(count, begin + WRITE_BLOCKSIZE), block_buffers[b]);
+            });
+            flush();
+            for (size_t b = 0; b < n; b++)
+                stream->write(block_buffers[b].data(), block_buffers[b].size());
+        }
+        rows += count;
+    }
+
+    /**
+     * @brief Writes the buffered output to the stream.
+     * Writes the header first if that hasn't happened yet.
+     */
+    void flush() {
+        check_open();
+        write_header();
+        stream->write(buffer.data(), buffer.size());
+        buffer.clear();
+        if (!*stream)
+            throw std::runtime_error("failed writing tfs file");
+    }
+
+    /**
+     * @brief Flushes and closes the file. Writing afterwards throws `std::runtime_error`.
+     * Called by the destructor, call it explicitly to get notified about errors.
+     */
+    void close() {
+        if (!stream) return;
+        flush();
+        stream->flush();
+        if (owned_stream)
+            owned_stream->close();
+        stream = nullptr;
+    }
+
+private:
+    void check_open() const {
+        if (!stream) throw std::runtime_error("tfs::writer has been closed");
+    }
+
+    void write_header() {
+        if (header_written) return;
+        std::string header;
+        for (auto& p : properties)
+            helper::append_property(header, p);
+        helper::append_column_header(header, names, types, widths);
+        buffer.insert(0, header);
+        header_written = true;
+    }
+
+    void begin_row() {
+        write_header();
+        current_cell = 0;
+        row_start = buffer.size();
+        buffer += "  ";
+    }
+
+    // drops the cells of the row written so far
+    void discard_row() {
+        buffer.resize(row_start);
+        current_cell = 0;
+    }
+
+    void end_row() {
+        buffer += '\n';
+        rows++;
+        if (buffer.size() >= buffer_size)
+            flush();
+    }
+
+    void next_cell() {
+        if (current_cell > 0) buffer += ' ';
+    }
+
+    // numbers are only widened (integers to `%le`), never cut
+    template<typename T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
+    void append_cell(T value) {
+        next_cell();
+        constexpr bool is_bool = std::is_same_v<T, bool>;
+        const DataType type = types[current_cell];
+        if (is_bool && type == DataType::B) {
+            helper::append_field(buffer, value ? "true" : "false", widths[current_cell], false);
+        }
+        else if (!is_bool && std::is_integral_v<T> && type == DataType::D) {
+            const int n = static_cast<int>(value);
+            if (static_cast<T>(n) != value || (n < 0) != (value < T(0)))
+                throw std::runtime_error("value out of range in column " + names[current_cell]);
+            helper::append_number(buffer, n, widths[current_cell]);
+        }
+        else if (!is_bool && type == DataType::LE) {
+            helper::append_number(buffer, static_cast<real>(value), widths[current_cell]);
+        }
+        else
+            throw std::runtime_error("type mismatch in column " + names[current_cell]);
+        current_cell++;
+    }
+
+    void append_cell(std::string_view value) {
+        next_cell();
+        if (types[current_cell] != DataType::S)
+            throw std::runtime_error("type mismatch in column " + names[current_cell]);
+        helper::append_string(buffer, value, widths[current_cell]);
+        current_cell++;
+    }
+
+    template<typename T>
+    void append_cell(const std::complex<T>& value) {
+        next_cell();
+        if (types[current_cell] != DataType::C)
+            throw std::runtime_error("type mismatch in column " + names[current_cell]);
+        helper::append_complex(buffer, std::complex<real>(value), widths[current_cell]);
+        current_cell++;
+    }
+
+    void append_cell(const std::string& value) { append_cell(std::string_view(value)); }
+    void append_cell(const char* value) { append_cell(std::string_view(value)); }
+
+    void append_cell(const data_value<real>& value) {
+        switch (value.type) {
+        case DataType::D:
+            append_cell(value.get_int());
+            break;
+        case DataType::LE:
+            append_cell(value.get_double());
+            break;
+        case DataType::S:
+            append_cell(std::string_view(value.get_string()));
+            break;
+        case DataType::B:
+            append_cell(value.get_bool());
+            break;
+        case DataType::C:
+            append_cell(value.get_complex());
+            break;
+        default:
+            throw std::runtime_error("not yet implemented");
+        }
+    }
+
+    void format_rows(const std::vector<const data_vector<real>*>& batch,
+                     size_t begin, size_t end, std::string& out) const {
+        size_t line_length = 3;
+        for (int w : widths)
+            line_length += w + 1;
+        out.reserve(out.size() + (end - begin) * line_length);
+
+        for (size_t i = begin; i < end; i++)
+        {
+            out += "  ";
+            for (size_t c = 0; c < batch.size(); c++) {
+                if (c > 0) out += ' ';
+                batch[c]->format_at(i, out, widths[c]);
+            }
+            out += '\n';
+        }
+    }
+};
+
+
 template <class ContainerT>
 void tokenize(const std::string &str, ContainerT &tokens,
           const std::string &delimiters = " ", bool trimEmpty = false)
@@ -685,11 +2600,17 @@ void tokenize(const std::string &str, ContainerT &tokens,
 // ---------------------------------------------------------------------------------------------
 
 template<typename real>
-dataframe<real>::dataframe(const std::string &path, const std::string& index)
+dataframe<real>::dataframe(const std::string &path, const std::string& index, std::pmr::memory_resource* resource)
+    : resource(resource)
 {
+    // the tokens of a line live in this arena, which is reset after every line. Lines with
+    // more tokens than fit on the stack spill over to the heap (until the next reset)
+    alignas(std::max_align_t) char scratch_buffer[16384];
+    std::pmr::monotonic_buffer_resource scratch(scratch_buffer, sizeof(scratch_buffer));
+
     std::ifstream file(path);
     std::string line;
-    while(std::getline(file, line) && !ini_complete) {
+    while(!ini_complete && std::getline(file, line)) {
         if (line[0] == '@')
             read_property(line);
         else if (line[0] == '*')
@@ -699,60 +2620,56 @@ dataframe<real>::dataframe(const std::string &path, const std::string& index)
         check_ini();
     }
     while(std::getline(file, line)) {
-        read_line(line);
+        read_line(line, &scratch);
+        scratch.release();
     }
+    // drop the room the columns reserved for growing, it would never be used
+    for (size_t i = 0; i < columns.size(); i++)
+        mutable_column(i).shrink_to_fit();
 
     if (index.empty()) return;
-    auto& index_col = get_column(index).as_string_vector();
-    for (int i = 0; i < index_col.size(); i++)
-        idx.insert(std::make_pair(index_col[i], i));
+    const size_t key_column = column_position(index);
+    if (key_column == helper::flat_index::npos)
+        throw std::runtime_error("couldn't find column " + index);
+    row_keys = columns[key_column];
+    auto& keys = row_keys->as_string_vector();
+    auto key_at = [&](size_t i) { return keys[i]; };
+    for (size_t i = 0; i < keys.size(); i++)
+        if (row_index.find(keys[i], key_at) == helper::flat_index::npos)
+            row_index.insert(keys[i], i, key_at);
 }
 
 template<typename real>
 data_vector<real>& dataframe<real>::get_column(const std::string& name)
 {
-    return columns[column_headers[name]];
+    const size_t i = column_position(name);
+    if (i == helper::flat_index::npos) throw std::runtime_error("couldn't find column " + name);
+    return mutable_column(i);
 }
 
 template<typename real>
 const data_vector<real>& dataframe<real>::get_column(const std::string& name) const
 {
-    return columns[column_headers.at(name)];
+    auto c = find_column(name);
+    if (!c) throw std::runtime_error("couldn't find column " + name);
+    return *c;
 }
 
 template<typename real>
-void dataframe<real>::to_file(const std::string& filename)
+void dataframe<real>::to_file(const std::string& filename) const
 {
-    std::cout << "writing to file\n";
-    std::cout << "this->size() = " << size() << "\n";
-    std::ofstream file(filename);
-
-    if (!file.is_open())
-        return;
-
+    writer<real> w(filename);
     for (auto& p : properties)
-    {
-        file << "@ "
-                 << std::setw(32) << p.name << " "
-                 << std::setw(4) << string_fromDT(p.value.type) << " "
-                 << p.value << "\n";
-    }
-    file << "* ";
-    for (auto& kvp : column_headers)
-        file << std::setw(FIELDWIDTH) << kvp.first << " ";
-    file << "\n$ ";
-    for (auto& c : column_headers)
-        file << std::setw(FIELDWIDTH) << string_fromDT(columns[c.second].get_type()) << " ";
-    file << "\n";
-
-    for (int i = 0; i < size(); i++)
-    {
-        file << "  ";
-        for (auto& c : column_headers)
-            columns[c.second].print_at(i, file);
-        file << "\n";
+        w.add_property(p.name, p.value);
+
+    std::vector<const data_vector<real>*> batch;
+    for (auto& c : columns) {
+        w.add_column(c->get_name(), c->get_type());
+        batch.push_back(c.get());
     }
-    file.close();
+
+    w.write_columns(batch);
+    w.close();
 }
 
 template<typename real>
@@ -760,6 +2677,9 @@ void dataframe<real>::read_property(const std::string& line)
 {
     std::vector<std::string> tokens;
     tokenize(line, tokens);
+    // a property that has been cut off is kept with an empty value
+    if (tokens.size() < 3) return;
+    if (tokens.size() < 4) tokens.emplace_back();
     auto t = DT_from_string(tokens[2]);
 
     switch (t)
@@ -767,14 +2687,25 @@ void dataframe<real>::read_property(const std::string& line)
     case DataType::D:
     {
         char* pEnd;
-        //properties.insert(std::make_pair(tokens[1], data_value<real>((int)strtol(tokens[3].c_str(), &pEnd, 10))));
-        properties.push_back(data_property<real>(tokens[1], data_value<real>((int)strtol(tokens[3].c_str(), &pEnd, 10))));
+        add_property(tokens[1], data_value<real>((int)strtol(tokens[3].c_str(), &pEnd, 10)));
         break;
     }
     case DataType::LE:
     {
         char* pEnd;
-        properties.push_back( data_property<real>(tokens[1], data_value<real>(strtod(tokens[3].c_str(), &pEnd))));
+        add_property(tokens[1], data_value<real>(strtod(tokens[3].c_str(), &pEnd)));
+        break;
+    }
+    case DataType::B:
+    {
+        add_property(tokens[1], data_value<real>(helper::parse_bool(tokens[3])));
+        break;
+    }
+    case DataType::C:
+    {
+        double re, im;
+        helper::parse_complex(tokens[3], re, im);
+        add_property(tokens[1], data_value<real>(std::complex<double>(re, im)));
         break;
     }
 
@@ -784,7 +2715,7 @@ void dataframe<real>::read_property(const std::string& line)
         std::copy(tokens.begin() + 3, tokens.end(),
               std::ostream_iterator<std::string>(ss, " "));
         //std::cout << ss.str() << std::endl;
-        properties.push_back(data_property<real>(tokens[1], ss.str()));
+        add_property(tokens[1], data_value<real>(ss.str()));
     }
 }
 
@@ -794,8 +2725,7 @@ void dataframe<real>::read_column_headers(const std::string& line)
     std::vector<std::string> tokens;
     tokenize(line, tokens);
 
-    for (int i = 0; i < tokens.size() - 1; i++)
-        column_headers.insert(std::make_pair(tokens[i + 1], i));
+    header_names.assign(tokens.begin() + 1, tokens.end());
 }
 
 template<typename real>
@@ -806,31 +2736,36 @@ void dataframe<real>::read_column_types(const std::string& line)
 
     for (auto it = tokens.begin() + 1; it != tokens.end(); ++it)
     {
-        columns.emplace_back(DT_from_string(*it), "");
+        push_column(data_vector<real>(DT_from_string(*it), "", resource));
     }
 }
 
 template<typename real>
-void dataframe<real>::read_line(const std::string& line)
+void dataframe<real>::read_line(const std::string& line, std::pmr::memory_resource* scratch)
 {
-    std::vector<std::string> tokens;
-    tokenize(line, tokens);
-
-    //std::cout << tokens.size() << " tokens: {" << tokens[0] << ", " << tokens[1] << ", " <<tokens[2] << ", ...}\n";
-
-    for (int i = 0; i < tokens.size(); i++)
-    {
-        columns[i].convert_back(tokens[i]);
-    }
+    std::pmr::vector<std::string_view> tokens(scratch);
+    tokens.reserve(columns.size() + 1);
+    tokenize(line, tokens, " \t\r", true);
+    if (tokens.empty()) return;
+
+    // a row cut short (e.g. by a crashed job) gets nulls for the missing cells,
+    // surplus cells are dropped
+    const size_t n = std::min(tokens.size(), columns.size());
+    for (size_t i = 0; i < n; i++)
+        mutable_column(i).convert_back(tokens[i]);
+    for (size_t i = n; i < columns.size(); i++)
+        mutable_column(i).push_null();
 }
 
 template<typename real>
 void dataframe<real>::check_ini()
 {
-    if (columns.size() > 0 && columns.size() == column_headers.size()){
-        for (auto kvp: this->column_headers) {
-            this->columns[kvp.second].set_name(kvp.first);
+    if (columns.size() > 0 && columns.size() == header_names.size()){
+        for (size_t i = 0; i < columns.size(); i++) {
+            mutable_column(i).set_name(header_names[i]);
         }
+        rebuild_column_index();
+        header_names.clear();
         ini_complete = true;
     }
 }
@@ -853,15 +2788,93 @@ void dataframe<real>::verify() const {
     using std::cout;
     using std::endl;
     cout << " -- verifying dataframe --\n";
-    for (auto& kvp : column_headers) {
-        cout << kvp.first << ": " << columns[kvp.second].size() << " elements \n";
+    for (auto& c : columns) {
+        cout << c->get_name() << ": " << c->size() << " elements \n";
     }
     cout << " per column in columns:\n";
     for(auto& c: columns)
-        cout << c.size()  << "elements\n";
+        cout << c->size()  << "elements\n";
 
     cout << endl;
 }
+template<typename real>
+memory_footprint dataframe<real>::memory_usage() const
+{
+    memory_footprint m;
+    for (auto& c : columns)
+        m += c->memory_usage();
+
+    m.index += sizeof(*this)
+            + columns.capacity() * sizeof(columns[0])
+            + column_index.memory_usage()
+            + property_index.memory_usage()
+            + properties.capacity() * sizeof(data_property<real>);
+    for (auto& p : properties) {
+        m.index += p.name.capacity();
+        if (p.value.type == DataType::S)
+            m.index += p.value.get_string().capacity();
+    }
+    m.index += row_index.memory_usage();
+    return m;
+}
+
+template<typename real>
+size_t dataframe<real>::estimate_memory_usage(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return 0;
+    const size_t file_size = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    // binary files hold the data just as it is in memory
+    char magic[sizeof(BINARY_MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    if (std::equal(magic, magic + sizeof(magic), BINARY_MAGIC) || (path.size() > 5 && path.substr(path.size() - 5) == ".btfs"))
+        return file_size;
+    file.seekg(0);
+
+    std::string line;
+    std::vector<std::string> type_tokens;
+    size_t header_bytes = 0;
+    while (std::getline(file, line)) {
+        header_bytes += line.size() + 1;
+        if (line[0] == '$') {
+            tokenize(line, type_tokens, " \t\r", true);
+            break;
+        }
+    }
+    if (type_tokens.size() < 2) return 0;
+
+    size_t row_bytes = 0;
+    for (auto it = type_tokens.begin() + 1; it != type_tokens.end(); ++it) {
+        switch (DT_from_string(*it)) {
+        case DataType::D: row_bytes += sizeof(int); break;
+        case DataType::LE: row_bytes += sizeof(real); break;
+        case DataType::S: row_bytes += sizeof(string_column::offset_t); break;
+        case DataType::C: row_bytes += 2 * sizeof(real); break;
+        case DataType::B: break;
+        }
+    }
+
+    // the row count and the string lengths are extrapolated from the first rows
+    size_t sampled_rows = 0, sampled_bytes = 0, string_bytes = 0;
+    std::vector<std::string_view> tokens;
+    while (sampled_rows < 1000 && std::getline(file, line)) {
+        tokens.clear();
+        tokenize(line, tokens, " \t\r", true);
+        if (tokens.empty()) continue;
+        sampled_bytes += line.size() + 1;
+        for (size_t i = 0; i + 1 < type_tokens.size() && i < tokens.size(); i++)
+            if (DT_from_string(type_tokens[i + 1]) == DataType::S)
+                string_bytes += tokens[i].size();
+        sampled_rows++;
+    }
+    if (sampled_rows == 0) return 0;
+
+    const size_t rows = (file_size - header_bytes) * sampled_rows / sampled_bytes;
+    return rows * row_bytes + rows * string_bytes / sampled_rows + rows / 8 + header_bytes;
+}
+
 template<typename real>
 std::ostream& operator<<(std::ostream& os, const dataframe<real>& df)
 {
@@ -871,6 +2884,11 @@ std::ostream& operator<<(std::ostream& os, const dataframe<real>& df)
 template<typename real>
 inline void dataframe<real>::write_to_binary(std::ostream& file) const
 {
+    file.write(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    file.write(reinterpret_cast<const char*>(&BINARY_VERSION), sizeof(uint32_t));
+    const uint32_t real_size = sizeof(real);
+    file.write(reinterpret_cast<const char*>(&real_size), sizeof(uint32_t));
+
     size_t numprops = properties.size();
     file.write(reinterpret_cast<char*>(&numprops), sizeof(size_t));
     for (auto& p : properties)
@@ -878,7 +2896,7 @@ inline void dataframe<real>::write_to_binary(std::ostream& file) const
     size_t numcols = columns.size();
     file.write(reinterpret_cast<char*>(&numcols), sizeof(size_t));
     for (auto& c : columns)
-        c.write_to_binary(file);
+        c->write_to_binary(file);
 }
 
 template<typename T>
@@ -892,29 +2910,45 @@ inline dataframe<T> dataframe<T>::read_from_binary(std::istream & file)
 template<typename real>
 inline void dataframe<real>::load_from_binary(std::istream& stream)
 {
+    // files without magic number are version 0, files before version 2 have been written with
+    // the same floating point type (we hope)
+    uint32_t version = 0;
+    uint32_t real_size = sizeof(real);
+    char magic[sizeof(BINARY_MAGIC)];
+    stream.read(magic, sizeof(magic));
+    if (std::equal(magic, magic + sizeof(magic), BINARY_MAGIC)) {
+        stream.read(reinterpret_cast<char*>(&version), sizeof(uint32_t));
+        if (version > BINARY_VERSION)
+            throw std::runtime_error("binary tfs file has been written by a newer version");
+        if (version >= 2)
+            stream.read(reinterpret_cast<char*>(&real_size), sizeof(uint32_t));
+    }
+    else
+        stream.seekg(-static_cast<std::streamoff>(sizeof(magic)), std::ios::cur);
+
     size_t numprops;
     stream.read(reinterpret_cast<char*>(&numprops), sizeof(size_t));
 
     for (size_t i = 0; i < numprops; i++)
-        properties.push_back(data_property<real>::read_from_binary(stream));
+    {
+        auto p = data_property<real>::read_from_binary(stream, real_size);
+        add_property(p.name, p.value);
+    }
 
     size_t numcolumns;
     stream.read(reinterpret_cast<char*>(&numcolumns), sizeof(size_t));
 
     columns.reserve(numcolumns);
-    for (size_t i = 0; i < numcolumns; i++)
-        columns.push_back(data_vector<real>{DataType::LE, ""});
-
     for (size_t i = 0; i < numcolumns; i++)
     {
-        auto& v = columns[i];
-        data_vector<real>::read_from_binary(stream, v);
-        column_headers.insert(std::make_pair(v.get_name(), i));
+        data_vector<real> v(DataType::LE, "", resource);
+        data_vector<real>::read_from_binary(stream, v, version, real_size);
+        push_column(std::move(v));
     }
 }
 
 template<typename real>
-inline void dataframe<real>::to_binary_file(const std::string & fname)
+inline void dataframe<real>::to_binary_file(const std::string & fname) const
 {
     std::fstream file(fname, std::ios::binary | std::ios::trunc | std::ios::out);
     write_to_binary(file);
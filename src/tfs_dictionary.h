@@ -0,0 +1,102 @@
+/**
+ * @file tfs_dictionary.h
+ * @author awegsche (you@domain.com)
+ * @brief Dictionary encoding of string columns.
+ *
+ * Columns like KEYWORD or PARENT repeat a few distinct values over and over. Their dictionary
+ * lists the distinct values once and gives every row the code of its value, so a predicate
+ * (e.g. a regular expression) runs once per distinct value, and the rows are found by looking
+ * their codes up in the table of results.
+ *
+ * @version 1.0
+ * @date 2021-03-08
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <string_view>
+#include <unordered_map>
+#include <limits>
+
+#include "tfs_dataframe.h"
+
+namespace tfs
+{
+/**
+     * @brief The distinct values of a string column and, for every row, the code of its value
+     * (the position of the value in the dictionary).
+     */
+class string_dictionary {
+public:
+    string_dictionary() = default;
+
+    /**
+     * @brief Encodes `strings`. Gives up (returns false, leaving `dictionary` empty) as soon
+     * as there are more than `max_values` distinct values, where a dictionary wouldn't save
+     * much. Null cells get the code of whatever string they hold.
+     */
+    static bool build(const string_column& strings, size_t max_values, string_dictionary& dictionary) {
+        dictionary = string_dictionary();
+        max_values = std::min<size_t>(max_values, std::numeric_limits<uint32_t>::max());
+
+        // the keys point into `strings`, which outlives the map
+        std::unordered_map<std::string_view, uint32_t> codes;
+        dictionary.row_codes.reserve(strings.size());
+        for (size_t i = 0; i < strings.size(); i++) {
+            const auto s = strings[i];
+            auto it = codes.find(s);
+            if (it == codes.end()) {
+                if (codes.size() == max_values) {
+                    dictionary = string_dictionary();
+                    return false;
+                }
+                it = codes.emplace(s, static_cast<uint32_t>(codes.size())).first;
+                dictionary.values.push_back(s);
+            }
+            dictionary.row_codes.push_back(it->second);
+        }
+        dictionary.values.shrink_to_fit();
+        return true;
+    }
+
+    /**
+     * @brief Number of distinct values
+     */
+    size_t size() const { return values.size(); }
+
+    /**
+     * @brief Number of rows encoded
+     */
+    size_t row_count() const { return row_codes.size(); }
+
+    std::string_view value(uint32_t code) const { return values[code]; }
+
+    uint32_t code(size_t row) const { return row_codes[row]; }
+    const uint32_t* codes() const { return row_codes.data(); }
+
+    /**
+     * @brief `pred(value)` for every distinct value, indexed by code
+     */
+    template<typename F>
+    std::vector<uint8_t> evaluate(F&& pred) const {
+        std::vector<uint8_t> table(values.size());
+        for (size_t code = 0; code < values.size(); code++)
+            table[code] = pred(values[code]) ? 1 : 0;
+        return table;
+    }
+
+    /**
+     * @brief Bytes allocated for the values and the codes
+     */
+    size_t memory_usage() const {
+        return values.memory_usage().total() + row_codes.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    string_column values;
+    std::vector<uint32_t> row_codes;
+};
+}  // namespace tfs
@@ -0,0 +1,291 @@
+/**
+ * @file tfs_edit.h
+ * @author awegsche (you@domain.com)
+ * @brief Editing of dataframes, with undo / redo.
+ *
+ * Edits don't touch the dataframe that has been loaded. Columns are split into chunks of
+ * `EDIT_CHUNK_ROWS` rows, and an edit only clones the chunk it changes. The undo journal
+ * stores pointers to the chunks before and after each edit, never whole columns.
+ * Readers (plots, the filter thread) get immutable snapshots, which stay consistent while
+ * editing goes on. Snapshots hold edited columns in one piece, like loaded ones, so readers
+ * scan them as fast; a new snapshot only rewrites the chunks edited since the one before.
+ *
+ * @version 1.0
+ * @date 2021-03-08
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <string_view>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "tfs_dataframe.h"
+
+namespace tfs
+{
+/**
+     * @brief Number of rows per chunk of an edited column
+     */
+constexpr size_t EDIT_CHUNK_ROWS = 4096;
+
+/**
+     * @brief An editable view of a dataframe snapshot.
+     *
+     * Reading goes through `with_cell` / `get`, which look up the edited chunk if there is one
+     * and the loaded dataframe otherwise. `snapshot` gives the current state as a dataframe.
+     * Only the chunks that have been edited since the last snapshot are written to it, the
+     * other columns are shared with the loaded dataframe.
+     *
+     * Not thread safe, use it from one thread and hand snapshots to the others.
+     *
+     * @tparam real
+     */
+template<typename real>
+class edit_session {
+public:
+    typedef std::shared_ptr<const data_vector<real>> chunk_ptr;
+
+    explicit edit_session(std::shared_ptr<const dataframe<real>> base, size_t chunk_rows = EDIT_CHUNK_ROWS)
+        : base(std::move(base))
+        , chunk_rows(chunk_rows)
+        , chunks(this->base->column_count())
+        , stale(this->base->column_count())
+        , assembled(this->base->column_count())
+        , current(this->base) {}
+
+    size_t size() const { return base->size(); }
+    size_t column_count() const { return base->column_count(); }
+
+    /**
+     * @brief Calls `fn(column, i)`, where `column[i]` is the current content of the cell
+     * at `row`, `col` (either in an edited chunk or in the loaded dataframe).
+     */
+    template<typename F>
+    decltype(auto) with_cell(size_t row, size_t col, F&& fn) const {
+        const data_vector<real>* chunk = find_chunk(col, row / chunk_rows);
+        if (chunk)
+            return fn(*chunk, row % chunk_rows);
+        return fn(base->get_column(col), row);
+    }
+
+    data_value<real> get(size_t row, size_t col) const {
+        return with_cell(row, col, [](auto& column, size_t i) { return column.value_at(i); });
+    }
+
+    bool is_valid(size_t row, size_t col) const {
+        return with_cell(row, col, [](auto& column, size_t i) { return column.is_valid(i); });
+    }
+
+    /**
+     * @brief Sets the cell at `row`, `col`. Throws `std::runtime_error` if `value` doesn't
+     * have the type of the column.
+     */
+    void set(size_t row, size_t col, const data_value<real>& value) {
+        edit(row, col, [&](data_vector<real>& chunk, size_t i) { chunk.set(i, value); });
+    }
+
+    /**
+     * @brief Makes the cell at `row`, `col` null
+     */
+    void set_null(size_t row, size_t col) {
+        edit(row, col, [](data_vector<real>& chunk, size_t i) { chunk.set_null(i); });
+    }
+
+    /**
+     * @brief Parses `text` like a cell in a TFS file and sets the cell at `row`, `col`.
+     * An empty `text` makes the cell null.
+     *
+     * @return false (and nothing is changed) if `text` can't be parsed
+     */
+    bool set_from_string(size_t row, size_t col, std::string_view text) {
+        if (text.empty()) {
+            set_null(row, col);
+            return true;
+        }
+        data_vector<real> parsed(base->get_column(col).get_type(), "");
+        parsed.convert_back(text);
+        if (!parsed.is_valid(0))
+            return false;
+        set(row, col, parsed.value_at(0));
+        return true;
+    }
+
+    bool can_undo() const { return !undo_stack.empty(); }
+    bool can_redo() const { return !redo_stack.empty(); }
+
+    /**
+     * @brief Reverts the last edit.
+     *
+     * @return the row that has been reverted, or `npos` if there was nothing to undo
+     */
+    size_t undo() {
+        if (undo_stack.empty()) return npos;
+        auto c = undo_stack.back();
+        undo_stack.pop_back();
+        restore(c.col, c.chunk, c.before);
+        redo_stack.push_back(c);
+        return c.row;
+    }
+
+    /**
+     * @brief Applies the last undone edit again.
+     *
+     * @return the row that has been changed, or `npos` if there was nothing to redo
+     */
+    size_t redo() {
+        if (redo_stack.empty()) return npos;
+        auto c = redo_stack.back();
+        redo_stack.pop_back();
+        restore(c.col, c.chunk, c.after);
+        undo_stack.push_back(c);
+        return c.row;
+    }
+
+    /**
+     * @brief The current state as immutable dataframe. Unchanged columns are shared with the
+     * loaded dataframe and with earlier snapshots. Edited columns are assembled from their
+     * chunks once, later snapshots only write the chunks edited since: in place if no earlier
+     * snapshot still uses the column, into a copy otherwise.
+     */
+    std::shared_ptr<const dataframe<real>> snapshot() {
+        if (std::all_of(stale.begin(), stale.end(), [](auto& s) { return s.empty(); }))
+            return current;
+
+        // if nobody else holds the last snapshot, it goes away here, and with it its
+        // references to the assembled columns
+        auto df = std::make_shared<dataframe<real>>(*current);
+        current.reset();
+        for (size_t col = 0; col < stale.size(); col++) {
+            if (stale[col].empty()) continue;
+            df->set_column(col, update(col));
+            stale[col].clear();
+        }
+        current = df;
+        return current;
+    }
+
+    /**
+     * @brief Memory held by the session: the loaded dataframe, the edited chunks (including
+     * those only kept for undo / redo) and the columns assembled for the last snapshot.
+     */
+    memory_footprint memory_usage() const {
+        memory_footprint m = base->memory_usage();
+        std::unordered_set<const data_vector<real>*> counted;
+        auto add = [&](const chunk_ptr& chunk) {
+            if (chunk && counted.insert(chunk.get()).second)
+                m += chunk->memory_usage();
+        };
+        for (auto& column : chunks)
+            for (auto& chunk : column) add(chunk);
+        for (auto& stack : {&undo_stack, &redo_stack})
+            for (auto& c : *stack) {
+                add(c.before);
+                add(c.after);
+            }
+        m.index += (undo_stack.capacity() + redo_stack.capacity()) * sizeof(change);
+
+        for (size_t col = 0; col < column_count(); col++)
+            if (&current->get_column(col) != &base->get_column(col))
+                m += current->column_memory_usage(col);
+        return m;
+    }
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+private:
+    // one entry of the undo journal
+    struct change {
+        size_t row;
+        size_t col;
+        size_t chunk;
+        chunk_ptr before;  // nullptr: the chunk was unchanged
+        chunk_ptr after;
+    };
+
+    std::shared_ptr<const dataframe<real>> base;
+    size_t chunk_rows;
+    // edited chunks per column, nullptr for chunks that haven't been changed.
+    // Chunks are never changed once they are stored, an edit replaces them with a changed copy
+    std::vector<std::vector<chunk_ptr>> chunks;
+    // per column, the chunks edited (or undone / redone) since the last snapshot
+    std::vector<std::vector<size_t>> stale;
+    // per column, the column of the last snapshot if it has been assembled from chunks
+    std::vector<std::shared_ptr<data_vector<real>>> assembled;
+    std::vector<change> undo_stack;
+    std::vector<change> redo_stack;
+    std::shared_ptr<const dataframe<real>> current;
+
+    size_t chunk_count() const { return (size() + chunk_rows - 1) / chunk_rows; }
+
+    const data_vector<real>* find_chunk(size_t col, size_t chunk) const {
+        auto& column = chunks.at(col);
+        return column.empty() ? nullptr : column[chunk].get();
+    }
+
+    template<typename F>
+    void edit(size_t row, size_t col, F&& apply) {
+        if (row >= size())
+            throw std::out_of_range("row out of range");
+        const size_t chunk = row / chunk_rows;
+        if (chunks.at(col).empty())
+            chunks[col].resize(chunk_count());
+
+        change c{row, col, chunk, chunks[col][chunk], nullptr};
+        // sliced rather than copy constructed, which would allocate from the default resource
+        auto edited = c.before
+                ? std::make_shared<data_vector<real>>(c.before->slice(0, c.before->size()))
+                : std::make_shared<data_vector<real>>(base->get_column(col).slice(
+                      chunk * chunk_rows, std::min(size(), (chunk + 1) * chunk_rows)));
+        apply(*edited, row - chunk * chunk_rows);
+        c.after = edited;
+
+        restore(col, chunk, c.after);
+        undo_stack.push_back(std::move(c));
+        redo_stack.clear();
+    }
+
+    void restore(size_t col, size_t chunk, const chunk_ptr& content) {
+        chunks[col][chunk] = content;
+        stale[col].push_back(chunk);
+    }
+
+    // the column `col` for a new snapshot
+    chunk_ptr update(size_t col) {
+        auto& edited_chunks = chunks[col];
+        auto& column = assembled[col];
+        if (std::all_of(edited_chunks.begin(), edited_chunks.end(), [](auto& c) { return c == nullptr; })) {
+            column.reset();
+            return base->share_column(col);
+        }
+
+        auto& original = base->get_column(col);
+        auto& changed = stale[col];
+        if (!column) {
+            // a copy of the loaded column with all edited chunks written over it
+            column = std::make_shared<data_vector<real>>(original.slice(0, size()));
+            changed.clear();
+            for (size_t chunk = 0; chunk < edited_chunks.size(); chunk++)
+                if (edited_chunks[chunk]) changed.push_back(chunk);
+        }
+        // held by `assembled` and the new snapshot only, or also by an older snapshot (or
+        // someone who took the column out of it), which must not see it change
+        else if (column.use_count() > 2)
+            column = std::make_shared<data_vector<real>>(column->slice(0, column->size()));
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+        for (size_t chunk : changed) {
+            const size_t begin = chunk * chunk_rows;
+            if (const data_vector<real>* edited = find_chunk(col, chunk))
+                column->overwrite(begin, *edited, 0, edited->size());
+            else
+                column->overwrite(begin, original, begin, std::min(size(), begin + chunk_rows));
+        }
+        return column;
+    }
+};
+}  // namespace tfs
@@ -0,0 +1,116 @@
+/**
+ * @file tfs_fuzzy.h
+ * @author awegsche (you@domain.com)
+ * @brief Approximate (fuzzy) string matching.
+ *
+ * Uses Myers' bit-parallel algorithm: a column of the edit distance matrix is kept as bit
+ * vectors of its vertical deltas, one bit per character of the pattern, so a pattern of up
+ * to 64 characters is matched against a text with a few word operations per text character.
+ *
+ * @version 1.0
+ * @date 2021-03-08
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <string_view>
+#include <algorithm>
+#include <stdexcept>
+
+#include "tfs_dataframe.h"
+
+namespace tfs
+{
+/**
+     * @brief A pattern for fuzzy search. Matching ignores the case of ASCII letters.
+     */
+class fuzzy_pattern {
+public:
+    /**
+     * @brief Longer patterns are cut to this many characters
+     */
+    static constexpr size_t MAX_LENGTH = 64;
+
+    /**
+     * @brief Throws `std::runtime_error` if `pattern` is empty
+     */
+    explicit fuzzy_pattern(std::string_view pattern) {
+        if (pattern.empty())
+            throw std::runtime_error("empty fuzzy pattern");
+        length = std::min(pattern.size(), MAX_LENGTH);
+        std::fill(std::begin(peq), std::end(peq), 0);
+        for (size_t i = 0; i < length; i++) {
+            const char c = helper::to_lower_ascii(pattern[i]);
+            peq[static_cast<unsigned char>(c)] |= uint64_t(1) << i;
+            // letters match in either case
+            if (c >= 'a' && c <= 'z')
+                peq[static_cast<unsigned char>(c - 'a' + 'A')] |= uint64_t(1) << i;
+        }
+    }
+
+    size_t size() const { return length; }
+
+    /**
+     * @brief The fewest insertions, deletions and substitutions that turn the pattern into
+     * some substring of `text` (0 if `text` contains the pattern)
+     */
+    unsigned distance(std::string_view text) const {
+        const uint64_t last = uint64_t(1) << (length - 1);
+        // vertical deltas of the current column: +1 (pv) and -1 (mv)
+        uint64_t pv = ~uint64_t(0);
+        uint64_t mv = 0;
+        unsigned score = static_cast<unsigned>(length);
+        unsigned best = score;
+        for (char c : text) {
+            const uint64_t eq = peq[static_cast<unsigned char>(c)];
+            const uint64_t xv = eq | mv;
+            const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            // horizontal deltas
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & last) score++;
+            else if (mh & last) score--;
+            // a match may start anywhere in the text, so the first row stays 0
+            ph <<= 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+            best = std::min(best, score);
+        }
+        return best;
+    }
+
+private:
+    // bit `i` of `peq[c]` is set if the `i`th character of the pattern is `c`
+    uint64_t peq[256];
+    size_t length;
+};
+
+/**
+     * @brief A row and how far it is from a fuzzy pattern
+     */
+struct fuzzy_match {
+    unsigned distance;
+    size_t row;
+
+    bool operator<(const fuzzy_match& other) const {
+        return distance != other.distance ? distance < other.distance : row < other.row;
+    }
+};
+
+namespace helper {
+/**
+         * @brief Keeps the `k` best (closest, then first) of `matches`, sorted
+         */
+inline void keep_best(std::vector<fuzzy_match>& matches, size_t k) {
+    if (matches.size() > k) {
+        std::nth_element(matches.begin(), matches.begin() + k, matches.end());
+        matches.resize(k);
+    }
+    std::sort(matches.begin(), matches.end());
+}
+}
+}  // namespace tfs
@@ -0,0 +1,169 @@
+/**
+ * @file tfs_glob.h
+ * @author awegsche (you@domain.com)
+ * @brief Glob patterns like `MQ*R1*` or `BPM?.*`, as MAD-X users write them.
+ *
+ * A pattern is compiled into the literal pieces between its `*`s. The first piece has to be at
+ * the start of the text, the last one at the end, and the others are found left to right with
+ * a substring search. Each piece is found at its leftmost position, never revisited, so matching
+ * is linear in the length of the text for pieces without `?` (no backtracking as in a regex engine).
+ *
+ * @version 1.0
+ * @date 2021-03-08
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+
+#include "tfs_dataframe.h"
+
+namespace tfs
+{
+/**
+     * @brief A compiled glob pattern: `*` stands for any characters (or none), `?` for any one
+     * character, everything else for itself. The whole text has to match, ignoring the case of
+     * ASCII letters (MAD-X upper cases names anyway) and the quotes around TFS strings.
+     */
+class glob_pattern {
+public:
+    explicit glob_pattern(std::string_view pattern) {
+        std::vector<piece> pieces(1);
+        for (char c : pattern) {
+            if (c == '*')
+                pieces.emplace_back();
+            else
+                pieces.back().text += helper::to_lower_ascii(c);
+        }
+        for (auto& p : pieces)
+            p.compile();
+
+        exact = pieces.size() == 1;
+        prefix = pieces.front();
+        if (!exact) {
+            suffix = pieces.back();
+            // `**` gives an empty piece that matches anywhere
+            for (size_t k = 1; k + 1 < pieces.size(); k++)
+                if (!pieces[k].text.empty())
+                    middle.push_back(pieces[k]);
+        }
+    }
+
+    /**
+     * @brief Whether all of `text` matches the pattern
+     */
+    bool matches(std::string_view text) const {
+        text = helper::unquoted(text);
+        const char* first = text.data();
+        const char* last = text.data() + text.size();
+        if (exact)
+            return text.size() == prefix.size() && prefix.fits(first);
+
+        if (text.size() < prefix.size() + suffix.size()
+                || !prefix.fits(first) || !suffix.fits(last - suffix.size()))
+            return false;
+        first += prefix.size();
+        last -= suffix.size();
+        for (auto& p : middle) {
+            first = p.find(first, last);
+            if (!first) return false;
+            first += p.size();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Whether the pattern is `*text*` (`text` without `?`), i.e. a plain substring search
+     * that ignores case. Sets `literal` to the substring, in lower case.
+     */
+    bool is_substring(std::string& literal) const {
+        if (exact || !prefix.text.empty() || !suffix.text.empty() || middle.size() != 1
+                || middle[0].anchor_size != middle[0].size() || middle[0].text.find('"') != std::string::npos)
+            return false;
+        literal = middle[0].text;
+        return true;
+    }
+
+    /**
+     * @brief The runs of characters (in lower case) that every matching text contains, for
+     * narrowing the search down (see `trigram_index::candidates`)
+     */
+    std::vector<std::string> required_substrings() const {
+        std::vector<std::string> substrings;
+        auto add_runs = [&](const piece& p) {
+            std::string run;
+            for (char c : p.text) {
+                if (c != '?') {
+                    run += c;
+                    continue;
+                }
+                if (!run.empty()) substrings.push_back(run);
+                run.clear();
+            }
+            if (!run.empty()) substrings.push_back(run);
+        };
+        add_runs(prefix);
+        add_runs(suffix);
+        for (auto& p : middle)
+            add_runs(p);
+        return substrings;
+    }
+
+private:
+    // characters between two `*`, in lower case, `?` for any character
+    struct piece {
+        std::string text;
+        // the longest run without `?`, searched for to find the piece
+        size_t anchor_offset = 0;
+        size_t anchor_size = 0;
+
+        size_t size() const { return text.size(); }
+
+        void compile() {
+            for (size_t k = 0; k < text.size();) {
+                size_t end = k;
+                while (end < text.size() && text[end] != '?') end++;
+                if (end - k > anchor_size) {
+                    anchor_offset = k;
+                    anchor_size = end - k;
+                }
+                k = end + 1;
+            }
+        }
+
+        // whether the piece matches the characters at `p`
+        bool fits(const char* p) const {
+            for (size_t k = 0; k < text.size(); k++)
+                if (text[k] != '?' && helper::to_lower_ascii(p[k]) != text[k]) return false;
+            return true;
+        }
+
+        // the leftmost position in `[first, last)` the piece matches at, nullptr if there is none
+        const char* find(const char* first, const char* last) const {
+            if (static_cast<size_t>(last - first) < size()) return nullptr;
+            if (anchor_size == 0) return first;
+            const std::string_view anchor(text.data() + anchor_offset, anchor_size);
+            // where the anchor of the last possible match ends
+            const char* anchor_last = last - (size() - anchor_offset - anchor_size);
+            const char* from = first + anchor_offset;
+            while (true) {
+                const char* hit = helper::find_substring(from, anchor_last, anchor, true);
+                if (hit == anchor_last) return nullptr;
+                if (fits(hit - anchor_offset)) return hit - anchor_offset;
+                from = hit + 1;
+            }
+        }
+    };
+
+    // no `*`: the text is `prefix`
+    bool exact = false;
+    // before the first `*` and after the last one
+    piece prefix;
+    piece suffix;
+    // between, in order
+    std::vector<piece> middle;
+};
+}  // namespace tfs
@@ -0,0 +1,605 @@
+/**
+ * @file tfs_query.h
+ * @author awegsche (you@domain.com)
+ * @brief Queries over the columns of a dataframe, like `NAME ~ ^BPM && BETX > 150 && abs(DX) < 0.1`.
+ *
+ * Syntax:
+ *  - string columns: `COLUMN ~ regex`, `COLUMN !~ regex`, `COLUMN == text`, `COLUMN != text`.
+ *    Regular expressions and texts containing spaces or `)` have to be quoted (`"..."` or `'...'`)
+ *  - numbers: comparisons (`<`, `<=`, `>`, `>=`, `==` or `=`, `!=`) of arithmetic expressions
+ *    (`+`, `-`, `*`, `/`, `abs()`, parentheses) over numeric columns and constants.
+ *    `%d` and `%b` columns count as numbers, `%c` columns as their magnitude
+ *  - conditions are combined with `&&` / `and`, `||` / `or`, `!` / `not` and parentheses
+ *
+ * Column names and keywords are case insensitive. Conditions on null cells are false
+ * (and true when negated with `!`).
+ *
+ * Queries are evaluated a column at a time: arithmetic runs over whole columns, comparisons
+ * pack their results into bitmaps 64 rows at a time, and conditions are combined word by word.
+ * Comparisons of a `%le` or `%d` column with a constant (and ranges like `S > 1000 && S < 2000`)
+ * use the column's zone map if there is one (see tfs_zonemap.h).
+ *
+ * @version 1.0
+ * @date 2021-03-08
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+#include "tfs_dataframe.h"
+#include "tfs_zonemap.h"
+
+namespace tfs
+{
+/**
+     * @brief A node of a parsed `query`
+     */
+struct query_node {
+    enum class kind {
+        // conditions
+        OR, AND, NOT, COMPARE, MATCH, STRING_EQUALS,
+        // numbers
+        NUMBER, COLUMN, ABS, NEGATE, ADD, SUBTRACT, MULTIPLY, DIVIDE,
+    };
+    enum class comparison { LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, EQUAL, NOT_EQUAL };
+
+    kind type;
+    comparison op = comparison::EQUAL;
+    // `!~` for MATCH, `!=` for STRING_EQUALS
+    bool negated = false;
+    double number = 0.0;
+    size_t column = 0;
+    // the regular expression of MATCH, the text of STRING_EQUALS
+    std::string text;
+    std::vector<query_node> children;
+
+    explicit query_node(kind type) : type(type) {}
+};
+
+/**
+     * @brief A parsed query, see tfs_query.h for the syntax
+     */
+class query {
+public:
+    /**
+     * @brief Parses `text` for the columns of `df`. Throws `std::runtime_error` if `text`
+     * is not a query or names a column `df` doesn't have.
+     */
+    template<typename real>
+    static query parse(std::string_view text, const dataframe<real>& df) {
+        std::vector<column_info> columns;
+        for (size_t c = 0; c < df.column_count(); c++)
+            columns.push_back({df.get_column(c).get_name(), df.get_column(c).get_type()});
+        parser p{text, 0, columns};
+        query q(p.parse_or());
+        p.skip_space();
+        if (p.pos != text.size())
+            throw std::runtime_error("unexpected '" + std::string(text.substr(p.pos)) + "' in query");
+        return q;
+    }
+
+    /**
+     * @brief The rows of `df` matching the query.
+     *
+     * @param match_strings `bitmap(const data_vector<real>& column, const std::string& regex)`,
+     * the rows of the string column `column` whose cells, without their quotes, match `regex`
+     * (null cells are masked out afterwards)
+     */
+    template<typename real, typename M>
+    bitmap evaluate(const dataframe<real>& df, M&& match_strings) const {
+        return evaluate(df, match_strings, [](const data_vector<real>&) -> const zone_map* { return nullptr; });
+    }
+
+    /**
+     * @brief The rows of `df` matching the query, using zone maps for ranges of numeric columns.
+     *
+     * @param zone_maps `const zone_map*(const data_vector<real>& column)`, the zone map of `column`
+     * or nullptr if it has none
+     */
+    template<typename real, typename M, typename Z>
+    bitmap evaluate(const dataframe<real>& df, M&& match_strings, Z&& zone_maps) const {
+        return evaluator<real, M, Z>{df, match_strings, zone_maps}.condition(root);
+    }
+
+    const query_node& get_root() const { return root; }
+
+private:
+    query_node root;
+
+    explicit query(query_node root) : root(std::move(root)) {}
+
+    struct column_info {
+        std::string name;
+        DataType type;
+    };
+
+    struct parser {
+        std::string_view s;
+        size_t pos;
+        const std::vector<column_info>& columns;
+
+        void skip_space() {
+            while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t')) pos++;
+        }
+
+        // consumes `token` if it is next
+        bool accept(std::string_view token) {
+            skip_space();
+            if (s.substr(pos, token.size()) != token) return false;
+            pos += token.size();
+            return true;
+        }
+
+        // consumes the keyword `word` (lower case) if it is next
+        bool accept_keyword(std::string_view word) {
+            skip_space();
+            const size_t end = identifier_end(pos);
+            if (!helper::equals_lowercase(s.substr(pos, end - pos), word)) return false;
+            pos = end;
+            return true;
+        }
+
+        size_t identifier_end(size_t from) const {
+            size_t end = from;
+            if (end < s.size() && (std::isalpha(static_cast<unsigned char>(s[end])) || s[end] == '_'))
+                while (end < s.size() && (std::isalnum(static_cast<unsigned char>(s[end])) || s[end] == '_' || s[end] == '.'))
+                    end++;
+            return end;
+        }
+
+        [[noreturn]] void fail(const std::string& what) const {
+            throw std::runtime_error(what + " at position " + std::to_string(pos) + " of query");
+        }
+
+        // the column named `name` (ignoring case), or `columns.size()`
+        size_t find_column(std::string_view name) const {
+            for (size_t c = 0; c < columns.size(); c++) {
+                auto& n = columns[c].name;
+                if (n.size() == name.size()
+                        && std::equal(n.begin(), n.end(), name.begin(),
+                                      [](char a, char b) { return helper::to_lower_ascii(a) == helper::to_lower_ascii(b); }))
+                    return c;
+            }
+            return columns.size();
+        }
+
+        query_node parse_or() {
+            query_node left = parse_and();
+            while (accept("||") || accept_keyword("or")) {
+                query_node node(query_node::kind::OR);
+                node.children.push_back(std::move(left));
+                node.children.push_back(parse_and());
+                left = std::move(node);
+            }
+            return left;
+        }
+
+        query_node parse_and() {
+            query_node left = parse_not();
+            while (accept("&&") || accept_keyword("and")) {
+                query_node node(query_node::kind::AND);
+                node.children.push_back(std::move(left));
+                node.children.push_back(parse_not());
+                left = std::move(node);
+            }
+            return left;
+        }
+
+        query_node parse_not() {
+            skip_space();
+            const bool bang = s.substr(pos, 1) == "!" && s.substr(pos, 2) != "!=";
+            if (bang || accept_keyword("not")) {
+                if (bang) pos++;
+                query_node node(query_node::kind::NOT);
+                node.children.push_back(parse_not());
+                return node;
+            }
+            // a parenthesized condition, or a comparison starting with a parenthesized number
+            if (s.substr(pos, 1) == "(") {
+                const size_t start = pos;
+                try {
+                    pos++;
+                    query_node inner = parse_or();
+                    if (!accept(")")) fail("missing ')'");
+                    return inner;
+                }
+                catch (const std::runtime_error&) {
+                    pos = start;
+                }
+            }
+            return parse_comparison();
+        }
+
+        query_node parse_comparison() {
+            skip_space();
+            const size_t end = identifier_end(pos);
+            const size_t column = find_column(s.substr(pos, end - pos));
+            if (column < columns.size() && columns[column].type == DataType::S) {
+                pos = end;
+                query_node node(query_node::kind::MATCH);
+                node.column = column;
+                if (accept("!~"))
+                    node.negated = true;
+                else if (accept("~"))
+                    node.negated = false;
+                else {
+                    node.type = query_node::kind::STRING_EQUALS;
+                    if (accept("!="))
+                        node.negated = true;
+                    else if (!accept("==") && !accept("="))
+                        fail("expected ~, !~, == or != after string column " + columns[column].name);
+                }
+                node.text = parse_text();
+                return node;
+            }
+
+            query_node node(query_node::kind::COMPARE);
+            node.children.push_back(parse_sum());
+            if (accept("<=")) node.op = query_node::comparison::LESS_EQUAL;
+            else if (accept(">=")) node.op = query_node::comparison::GREATER_EQUAL;
+            else if (accept("==")) node.op = query_node::comparison::EQUAL;
+            else if (accept("!=")) node.op = query_node::comparison::NOT_EQUAL;
+            else if (accept("<")) node.op = query_node::comparison::LESS;
+            else if (accept(">")) node.op = query_node::comparison::GREATER;
+            else if (accept("=")) node.op = query_node::comparison::EQUAL;
+            else fail("expected a comparison");
+            node.children.push_back(parse_sum());
+            return node;
+        }
+
+        // a quoted text, or everything up to the next white space or ')'
+        std::string parse_text() {
+            skip_space();
+            if (pos < s.size() && (s[pos] == '"' || s[pos] == '\'')) {
+                const auto close = s.find(s[pos], pos + 1);
+                if (close == std::string_view::npos) fail("missing closing quote");
+                std::string text(s.substr(pos + 1, close - pos - 1));
+                pos = close + 1;
+                return text;
+            }
+            const size_t start = pos;
+            while (pos < s.size() && s[pos] != ' ' && s[pos] != '\t' && s[pos] != ')') pos++;
+            if (pos == start) fail("expected a text");
+            return std::string(s.substr(start, pos - start));
+        }
+
+        query_node parse_sum() {
+            query_node left = parse_product();
+            while (true) {
+                query_node::kind type;
+                if (accept("+")) type = query_node::kind::ADD;
+                else if (accept("-")) type = query_node::kind::SUBTRACT;
+                else return left;
+                query_node node(type);
+                node.children.push_back(std::move(left));
+                node.children.push_back(parse_product());
+                left = std::move(node);
+            }
+        }
+
+        query_node parse_product() {
+            query_node left = parse_unary();
+            while (true) {
+                query_node::kind type;
+                if (accept("*")) type = query_node::kind::MULTIPLY;
+                else if (accept("/")) type = query_node::kind::DIVIDE;
+                else return left;
+                query_node node(type);
+                node.children.push_back(std::move(left));
+                node.children.push_back(parse_unary());
+                left = std::move(node);
+            }
+        }
+
+        query_node parse_unary() {
+            if (accept("-")) {
+                query_node node(query_node::kind::NEGATE);
+                node.children.push_back(parse_unary());
+                return node;
+            }
+            if (accept("(")) {
+                query_node inner = parse_sum();
+                if (!accept(")")) fail("missing ')'");
+                return inner;
+            }
+            skip_space();
+            if (pos < s.size() && (std::isdigit(static_cast<unsigned char>(s[pos])) || s[pos] == '.')) {
+                query_node node(query_node::kind::NUMBER);
+                auto result = std::from_chars(s.data() + pos, s.data() + s.size(), node.number);
+                if (result.ec != std::errc()) fail("bad number");
+                pos = result.ptr - s.data();
+                return node;
+            }
+
+            const size_t end = identifier_end(pos);
+            const std::string_view name = s.substr(pos, end - pos);
+            if (name.empty()) fail("expected a number or column");
+            if (helper::equals_lowercase(name, "abs")) {
+                pos = end;
+                if (!accept("(")) fail("expected '(' after abs");
+                query_node node(query_node::kind::ABS);
+                node.children.push_back(parse_sum());
+                if (!accept(")")) fail("missing ')'");
+                return node;
+            }
+            const size_t column = find_column(name);
+            if (column == columns.size()) fail("unknown column " + std::string(name));
+            if (columns[column].type == DataType::S) fail("string column " + columns[column].name + " used as number");
+            pos = end;
+            query_node node(query_node::kind::COLUMN);
+            node.column = column;
+            return node;
+        }
+    };
+
+    // the values of a numeric expression: a whole column or a constant, with the rows
+    // that are not null (all if `valid` is empty)
+    struct numbers {
+        std::vector<double> values;
+        double constant = 0.0;
+        bool is_constant = false;
+        bitmap valid;
+    };
+
+    template<typename real, typename M, typename Z>
+    struct evaluator {
+        const dataframe<real>& df;
+        M& match_strings;
+        Z& zone_maps;
+
+        size_t rows() const { return df.size(); }
+
+        // rows set in `mask` and valid in `valid` (if not empty)
+        static bitmap& restrict_to(bitmap& mask, const bitmap& valid) {
+            if (!valid.empty()) mask &= valid;
+            return mask;
+        }
+
+        bitmap condition(const query_node& node) {
+            switch (node.type) {
+            case query_node::kind::OR:
+                return condition(node.children[0]) | condition(node.children[1]);
+            case query_node::kind::AND:
+            {
+                // two ends of a range of the same column are looked up together
+                size_t left_column, right_column;
+                value_range left_range, right_range;
+                if (as_range(node.children[0], left_column, left_range)
+                        && as_range(node.children[1], right_column, right_range)
+                        && left_column == right_column)
+                    return select(left_column, left_range.intersect(right_range));
+
+                bitmap left = condition(node.children[0]);
+                if (left.none()) return left;
+                return left &= condition(node.children[1]);
+            }
+            case query_node::kind::NOT:
+                return ~condition(node.children[0]);
+            case query_node::kind::COMPARE:
+            {
+                size_t column;
+                value_range range;
+                if (as_range(node, column, range))
+                    return select(column, range);
+                return compare(node.op, number(node.children[0]), number(node.children[1]));
+            }
+            case query_node::kind::MATCH:
+            {
+                auto& column = df.get_column(node.column);
+                bitmap matched = match_strings(column, node.text);
+                if (node.negated)
+                    matched.flip();
+                // null cells hold "", which patterns like `^$` match
+                return column.validity_mask() ? matched &= *column.validity_mask() : matched;
+            }
+            case query_node::kind::STRING_EQUALS:
+            {
+                auto& column = df.get_column(node.column);
+                auto& strings = column.as_string_vector();
+                // cells keep the quotes of the file, the text of the query doesn't
+                bitmap result = pack([&](size_t i) { return (helper::unquoted(strings[i]) == node.text) != node.negated; });
+                return column.validity_mask() ? result &= *column.validity_mask() : result;
+            }
+            default:
+                throw std::runtime_error("query: number used as condition");
+            }
+        }
+
+        // whether `node` compares a column that has a zone map with a constant (other than
+        // with `!=`), and which values of the column it takes
+        bool as_range(const query_node& node, size_t& column, value_range& range) const {
+            if (node.type != query_node::kind::COMPARE || node.op == query_node::comparison::NOT_EQUAL)
+                return false;
+            auto& a = node.children[0];
+            auto& b = node.children[1];
+            auto op = node.op;
+            double value;
+            if (a.type == query_node::kind::COLUMN && b.type == query_node::kind::NUMBER) {
+                column = a.column;
+                value = b.number;
+            }
+            else if (a.type == query_node::kind::NUMBER && b.type == query_node::kind::COLUMN) {
+                // `value < column` is `column > value`
+                column = b.column;
+                value = a.number;
+                switch (op) {
+                case query_node::comparison::LESS: op = query_node::comparison::GREATER; break;
+                case query_node::comparison::LESS_EQUAL: op = query_node::comparison::GREATER_EQUAL; break;
+                case query_node::comparison::GREATER: op = query_node::comparison::LESS; break;
+                case query_node::comparison::GREATER_EQUAL: op = query_node::comparison::LESS_EQUAL; break;
+                default: break;
+                }
+            }
+            else
+                return false;
+
+            auto& values = df.get_column(column);
+            if ((values.get_type() != DataType::LE && values.get_type() != DataType::D) || !zone_maps(values))
+                return false;
+
+            range = value_range();
+            switch (op) {
+            case query_node::comparison::LESS: range.hi = value; range.hi_open = true; break;
+            case query_node::comparison::LESS_EQUAL: range.hi = value; break;
+            case query_node::comparison::GREATER: range.lo = value; range.lo_open = true; break;
+            case query_node::comparison::GREATER_EQUAL: range.lo = value; break;
+            default: range.lo = range.hi = value;
+            }
+            return true;
+        }
+
+        // the valid rows of `column` with a value in `range`, through the zone map
+        bitmap select(size_t column, const value_range& range) const {
+            auto& values = df.get_column(column);
+            bitmap result = zone_maps(values)->select(values, range);
+            return values.validity_mask() ? result &= *values.validity_mask() : result;
+        }
+
+        // packs `fn(i)` of all rows into a bitmap, 64 rows per word
+        template<typename F>
+        bitmap pack(F&& fn) const {
+            bitmap result(rows());
+            bitmap::word_t* words = result.data();
+            for (size_t w = 0; w < bitmap::word_count(rows()); w++) {
+                const size_t first = w * bitmap::WORD_BITS;
+                const size_t n = std::min(bitmap::WORD_BITS, rows() - first);
+                bitmap::word_t word = 0;
+                for (size_t k = 0; k < n; k++)
+                    word |= bitmap::word_t(fn(first + k)) << k;
+                words[w] = word;
+            }
+            return result;
+        }
+
+        template<typename Op>
+        bitmap compare_with(const numbers& a, const numbers& b, Op op) const {
+            const double* x = a.values.data();
+            const double* y = b.values.data();
+            if (a.is_constant && b.is_constant)
+                return bitmap(rows(), op(a.constant, b.constant));
+            if (a.is_constant)
+                return pack([&, c = a.constant](size_t i) { return op(c, y[i]); });
+            if (b.is_constant)
+                return pack([&, c = b.constant](size_t i) { return op(x[i], c); });
+            return pack([&](size_t i) { return op(x[i], y[i]); });
+        }
+
+        bitmap compare(query_node::comparison op, const numbers& a, const numbers& b) const {
+            bitmap result;
+            switch (op) {
+            case query_node::comparison::LESS:
+                result = compare_with(a, b, [](double x, double y) { return x < y; }); break;
+            case query_node::comparison::LESS_EQUAL:
+                result = compare_with(a, b, [](double x, double y) { return x <= y; }); break;
+            case query_node::comparison::GREATER:
+                result = compare_with(a, b, [](double x, double y) { return x > y; }); break;
+            case query_node::comparison::GREATER_EQUAL:
+                result = compare_with(a, b, [](double x, double y) { return x >= y; }); break;
+            case query_node::comparison::EQUAL:
+                result = compare_with(a, b, [](double x, double y) { return x == y; }); break;
+            case query_node::comparison::NOT_EQUAL:
+                result = compare_with(a, b, [](double x, double y) { return x != y; }); break;
+            }
+            restrict_to(result, a.valid);
+            return restrict_to(result, b.valid);
+        }
+
+        numbers column_values(size_t index) const {
+            auto& column = df.get_column(index);
+            numbers result;
+            result.values.resize(rows());
+            switch (column.get_type()) {
+            case DataType::LE:
+                std::copy(column.as_double_vector().begin(), column.as_double_vector().end(), result.values.begin());
+                break;
+            case DataType::D:
+                std::copy(column.as_int_vector().begin(), column.as_int_vector().end(), result.values.begin());
+                break;
+            case DataType::B:
+                for (size_t i = 0; i < rows(); i++)
+                    result.values[i] = column.as_bool_vector()[i] ? 1.0 : 0.0;
+                break;
+            case DataType::C:
+            {
+                auto magnitude = column.as_complex_vector().magnitude();
+                std::copy(magnitude.begin(), magnitude.end(), result.values.begin());
+                break;
+            }
+            case DataType::S:
+                throw std::runtime_error("query: string column " + column.get_name() + " used as number");
+            }
+            if (column.validity_mask())
+                result.valid = *column.validity_mask();
+            return result;
+        }
+
+        template<typename Op>
+        static numbers apply(numbers a, Op op) {
+            if (a.is_constant)
+                a.constant = op(a.constant);
+            else
+                for (auto& v : a.values) v = op(v);
+            return a;
+        }
+
+        template<typename Op>
+        static numbers apply(numbers a, numbers b, Op op) {
+            if (a.is_constant && b.is_constant) {
+                a.constant = op(a.constant, b.constant);
+                return a;
+            }
+            // the result goes into the operand that is a column
+            if (a.is_constant) {
+                for (auto& v : b.values) v = op(a.constant, v);
+                return b;
+            }
+            if (b.is_constant) {
+                for (auto& v : a.values) v = op(v, b.constant);
+                return a;
+            }
+            for (size_t i = 0; i < a.values.size(); i++)
+                a.values[i] = op(a.values[i], b.values[i]);
+            if (a.valid.empty())
+                a.valid = std::move(b.valid);
+            else
+                restrict_to(a.valid, b.valid);
+            return a;
+        }
+
+        numbers number(const query_node& node) const {
+            switch (node.type) {
+            case query_node::kind::NUMBER:
+            {
+                numbers result;
+                result.is_constant = true;
+                result.constant = node.number;
+                return result;
+            }
+            case query_node::kind::COLUMN:
+                return column_values(node.column);
+            case query_node::kind::ABS:
+                return apply(number(node.children[0]), [](double x) { return std::abs(x); });
+            case query_node::kind::NEGATE:
+                return apply(number(node.children[0]), [](double x) { return -x; });
+            case query_node::kind::ADD:
+                return apply(number(node.children[0]), number(node.children[1]), [](double x, double y) { return x + y; });
+            case query_node::kind::SUBTRACT:
+                return apply(number(node.children[0]), number(node.children[1]), [](double x, double y) { return x - y; });
+            case query_node::kind::MULTIPLY:
+                return apply(number(node.children[0]), number(node.children[1]), [](double x, double y) { return x * y; });
+            case query_node::kind::DIVIDE:
+                return apply(number(node.children[0]), number(node.children[1]), [](double x, double y) { return x / y; });
+            default:
+                throw std::runtime_error("query: condition used as number");
+            }
+        }
+    };
+};
+}  // namespace tfs
@@ -0,0 +1,338 @@
+/**
+ * @file tfs_trigram.h
+ * @author awegsche (you@domain.com)
+ * @brief Trigram index over the string columns of a dataframe.
+ *
+ * For every sequence of three characters (case folded), the index lists the rows where it
+ * appears in any `%s` column. A substring of three or more characters can only be in rows that
+ * are on the lists of all of its trigrams, so a search only needs to check these rows.
+ * The index narrows the search down, it never decides a match on its own.
+ *
+ * The index can be appended to a binary file (`*.btfs`) after the dataframe, readers that
+ * don't know about it stop before it.
+ *
+ * @version 1.0
+ * @date 2021-03-08
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "tfs_dataframe.h"
+
+namespace tfs
+{
+/**
+     * @brief Tag of the trigram index section in binary files
+     */
+constexpr char TRIGRAM_MAGIC[4] = {'T', 'R', 'I', 'G'};
+
+namespace helper {
+/**
+         * @brief The three characters at `p`, ASCII letters in lower case
+         */
+inline uint32_t trigram_key(const char* p) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(to_lower_ascii(p[0]))) << 16
+         | static_cast<uint32_t>(static_cast<unsigned char>(to_lower_ascii(p[1]))) << 8
+         | static_cast<uint32_t>(static_cast<unsigned char>(to_lower_ascii(p[2])));
+}
+
+/**
+         * @brief Substrings (in lower case) that every string matching the regular expression
+         * `pattern` has to contain. Only the parts outside of groups and character classes are
+         * looked at, characters that may be repeated zero times are left out. Patterns with
+         * alternatives (`|`), extended syntax (`(?x)`) or quoting (`\Q`) give no substrings.
+         *
+         * Errs on the safe side: any string matching `pattern` contains all substrings returned,
+         * but not every requirement of `pattern` is found.
+         */
+inline std::vector<std::string> required_substrings(std::string_view pattern) {
+    std::vector<std::string> substrings;
+    std::string run;
+    auto end_run = [&]() {
+        if (!run.empty()) substrings.push_back(run);
+        run.clear();
+    };
+    auto is_alnum = [](char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+    };
+    // skips a character class starting at `pattern[i] == '['`, returns the index of its `]`
+    auto skip_class = [&](size_t i) {
+        i++;
+        if (i < pattern.size() && pattern[i] == '^') i++;
+        if (i < pattern.size() && pattern[i] == ']') i++;
+        for (; i < pattern.size() && pattern[i] != ']'; i++) {
+            if (pattern[i] == '\\') i++;
+            else if (pattern[i] == '[' && i + 1 < pattern.size() && pattern[i + 1] == ':') {
+                auto close = pattern.find(":]", i + 2);
+                if (close == std::string_view::npos) return pattern.size();
+                i = close + 1;
+            }
+        }
+        return i;
+    };
+
+    if (pattern.find("\\Q") != std::string_view::npos)
+        return {};
+
+    size_t depth = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        const char c = pattern[i];
+        if (c == '\\') {
+            if (i + 1 >= pattern.size()) return {};
+            const char escaped = pattern[++i];
+            if (depth > 0) continue;
+            if (is_alnum(escaped)) {
+                // a class, anchor, back reference, ... and its arguments (`\x41`, `\p{L}`)
+                end_run();
+                while (i + 1 < pattern.size() && (is_alnum(pattern[i + 1]) || std::strchr("{},<>'", pattern[i + 1])))
+                    i++;
+            }
+            else if (static_cast<unsigned char>(escaped) >= 0x80)
+                end_run();
+            else
+                run += escaped;
+            continue;
+        }
+        if (c == '[') {
+            i = skip_class(i);
+            if (depth == 0) end_run();
+            continue;
+        }
+        if (c == '(') {
+            // inline options: extended syntax changes the meaning of white space
+            if (i + 1 < pattern.size() && pattern[i + 1] == '?') {
+                const auto flags_end = pattern.find_first_of(":)", i);
+                if (pattern.substr(i, flags_end - i).find('x') != std::string_view::npos)
+                    return {};
+            }
+            if (depth == 0) end_run();
+            depth++;
+            continue;
+        }
+        if (c == ')') {
+            if (depth > 0) depth--;
+            continue;
+        }
+        if (c == '|') {
+            if (depth == 0) return {};
+            continue;
+        }
+        if (depth > 0) continue;
+
+        switch (c) {
+        case '?':
+        case '*':
+        case '+':
+        case '{':
+            // the last character may be missing (or is repeated, which is left out as well,
+            // quantifiers can be followed by more quantifiers)
+            if (!run.empty()) run.pop_back();
+            end_run();
+            if (c == '{') {
+                const auto close = pattern.find('}', i);
+                i = close == std::string_view::npos ? pattern.size() : close;
+            }
+            break;
+        case '.':
+        case '^':
+        case '$':
+            end_run();
+            break;
+        default:
+            if (static_cast<unsigned char>(c) >= 0x80)
+                end_run();
+            else
+                run += to_lower_ascii(c);
+        }
+    }
+    end_run();
+
+    substrings.erase(std::remove_if(substrings.begin(), substrings.end(),
+                                    [](auto& s) { return s.size() < 3; }),
+                     substrings.end());
+    return substrings;
+}
+}
+
+/**
+     * @brief Lists, for every trigram, the rows containing it in one of the string columns.
+     *
+     * Built for one dataframe, and valid for all snapshots that share its string columns
+     * (see `covers`). Edits of a string column make it invalid for the edited snapshots.
+     */
+class trigram_index {
+public:
+    trigram_index() = default;
+
+    /**
+     * @brief Indexes the string columns of `df`. Null cells are left out.
+     */
+    template<typename real>
+    static trigram_index build(const dataframe<real>& df) {
+        if (df.size() > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("too many rows for a trigram index");
+
+        trigram_index index;
+        index.row_count = df.size();
+        index.columns = string_columns(df);
+
+        // (trigram, row) pairs, sorted and without duplicates they are the posting lists
+        std::vector<uint64_t> pairs;
+        for (size_t c = 0; c < df.column_count(); c++) {
+            auto& column = df.get_column(c);
+            if (column.get_type() != DataType::S) continue;
+            auto& strings = column.as_string_vector();
+            pairs.reserve(pairs.size() + strings.byte_size());
+            for (size_t row = 0; row < strings.size(); row++) {
+                if (!column.is_valid(row)) continue;
+                const auto s = strings[row];
+                for (size_t k = 0; k + 3 <= s.size(); k++)
+                    pairs.push_back(static_cast<uint64_t>(helper::trigram_key(s.data() + k)) << 32 | row);
+            }
+        }
+        std::sort(pairs.begin(), pairs.end());
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+        index.postings.reserve(pairs.size());
+        for (uint64_t pair : pairs) {
+            const uint32_t key = static_cast<uint32_t>(pair >> 32);
+            if (index.keys.empty() || index.keys.back() != key) {
+                index.keys.push_back(key);
+                index.starts.push_back(static_cast<uint32_t>(index.postings.size()));
+            }
+            index.postings.push_back(static_cast<uint32_t>(pair));
+        }
+        index.starts.push_back(static_cast<uint32_t>(index.postings.size()));
+        return index;
+    }
+
+    /**
+     * @brief Whether the index applies to `df`, i.e. `df` has the very string columns that
+     * have been indexed.
+     */
+    template<typename real>
+    bool covers(const dataframe<real>& df) const {
+        if (df.size() != row_count) return false;
+        auto other = string_columns(df);
+        return std::equal(columns.begin(), columns.end(), other.begin(), other.end(),
+                          [](auto& a, auto& b) { return a.get() == b.get(); });
+    }
+
+    /**
+     * @brief The rows that may contain all of `substrings` (ignoring case), ascending.
+     * Substrings shorter than three characters don't narrow anything down.
+     *
+     * @return false if no substring narrows anything down, i.e. all rows are candidates
+     */
+    bool candidates(const std::vector<std::string>& substrings, std::vector<size_t>& out) const {
+        // the posting lists of all trigrams, shortest first
+        std::vector<std::pair<const uint32_t*, const uint32_t*>> lists;
+        for (auto& s : substrings) {
+            for (size_t k = 0; k + 3 <= s.size(); k++) {
+                auto it = std::lower_bound(keys.begin(), keys.end(), helper::trigram_key(s.data() + k));
+                if (it == keys.end() || *it != helper::trigram_key(s.data() + k)) {
+                    // a trigram no row has
+                    out.clear();
+                    return true;
+                }
+                const size_t key = it - keys.begin();
+                lists.emplace_back(postings.data() + starts[key], postings.data() + starts[key + 1]);
+            }
+        }
+        if (lists.empty()) return false;
+        std::sort(lists.begin(), lists.end(),
+                  [](auto& a, auto& b) { return a.second - a.first < b.second - b.first; });
+
+        out.assign(lists[0].first, lists[0].second);
+        for (size_t l = 1; l < lists.size() && !out.empty(); l++) {
+            auto last = std::set_intersection(out.begin(), out.end(), lists[l].first, lists[l].second, out.begin());
+            out.erase(last, out.end());
+        }
+        return true;
+    }
+
+    bool empty() const { return keys.empty(); }
+
+    /**
+     * @brief Number of rows of the indexed dataframe
+     */
+    size_t size() const { return row_count; }
+
+    /**
+     * @brief Bytes allocated for the posting lists and their keys
+     */
+    size_t memory_usage() const {
+        return (keys.capacity() + starts.capacity() + postings.capacity()) * sizeof(uint32_t);
+    }
+
+    void write_to_binary(std::ostream& file) const {
+        file.write(TRIGRAM_MAGIC, sizeof(TRIGRAM_MAGIC));
+        const size_t counts[] = {row_count, columns.size(), keys.size(), postings.size()};
+        file.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+        file.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(starts.data()), starts.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(postings.data()), postings.size() * sizeof(uint32_t));
+    }
+
+    /**
+     * @brief Reads an index written by `write_to_binary` right after `df` (loaded from the same
+     * stream). Returns false, leaving `index` empty, if there is none or it doesn't fit `df`.
+     */
+    template<typename real>
+    static bool read_from_binary(std::istream& file, const dataframe<real>& df, trigram_index& index) {
+        index = trigram_index();
+        char magic[sizeof(TRIGRAM_MAGIC)];
+        if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), TRIGRAM_MAGIC))
+            return false;
+
+        size_t counts[4];
+        file.read(reinterpret_cast<char*>(counts), sizeof(counts));
+        auto columns = string_columns(df);
+        if (!file || counts[0] != df.size() || counts[1] != columns.size())
+            return false;
+
+        index.row_count = counts[0];
+        index.columns = std::move(columns);
+        index.keys.resize(counts[2]);
+        index.starts.resize(counts[2] + 1);
+        index.postings.resize(counts[3]);
+        file.read(reinterpret_cast<char*>(index.keys.data()), index.keys.size() * sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(index.starts.data()), index.starts.size() * sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(index.postings.data()), index.postings.size() * sizeof(uint32_t));
+        if (!file) {
+            index = trigram_index();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // sorted trigrams, the rows of `keys[i]` are `postings[starts[i]] .. postings[starts[i + 1]]`
+    std::vector<uint32_t> keys;
+    std::vector<uint32_t> starts;
+    std::vector<uint32_t> postings;
+    size_t row_count = 0;
+    // the indexed columns, compared by address in `covers` (and kept alive so the addresses
+    // can't be reused)
+    std::vector<std::shared_ptr<const void>> columns;
+
+    template<typename real>
+    static std::vector<std::shared_ptr<const void>> string_columns(const dataframe<real>& df) {
+        std::vector<std::shared_ptr<const void>> result;
+        for (size_t c = 0; c < df.column_count(); c++)
+            if (df.get_column(c).get_type() == DataType::S)
+                result.push_back(df.share_column(c));
+        return result;
+    }
+};
+}  // namespace tfs
@@ -0,0 +1,199 @@
+/**
+ * @file tfs_zonemap.h
+ * @author awegsche (you@domain.com)
+ * @brief Zone maps (per block minimum and maximum) of numeric columns.
+ *
+ * Columns like S or TURN are sorted or at least clustered, so most blocks of `ZONE_ROWS` rows
+ * are either completely inside or completely outside of a range like `1000 <= S <= 2000`.
+ * The zone map tells which: blocks outside are skipped, blocks inside are set in one go, and
+ * only the blocks in between are compared row by row. Sorted columns are binary searched.
+ *
+ * @version 1.0
+ * @date 2021-03-08
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#pragma once
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "tfs_dataframe.h"
+
+namespace tfs
+{
+/**
+     * @brief Number of rows per zone, a multiple of the bits in a bitmap word
+     */
+constexpr size_t ZONE_ROWS = 1024;
+
+/**
+     * @brief An interval of numbers, each end open or closed. NaN is in no range.
+     */
+struct value_range {
+    double lo = -std::numeric_limits<double>::infinity();
+    double hi = std::numeric_limits<double>::infinity();
+    bool lo_open = false;
+    bool hi_open = false;
+
+    // `x` comes before the range
+    bool below(double x) const { return x < lo || (lo_open && x == lo); }
+    // `x` comes after the range
+    bool above(double x) const { return x > hi || (hi_open && x == hi); }
+
+    // comparisons with NaN are false, so NaN is in no range
+    bool contains(double x) const {
+        return (lo_open ? x > lo : x >= lo) & (hi_open ? x < hi : x <= hi);
+    }
+
+    /**
+     * @brief Whether some number in `[min, max]` is in the range (false if `min > max`)
+     */
+    bool overlaps(double min, double max) const { return min <= max && !above(min) && !below(max); }
+
+    /**
+     * @brief Narrows the range down to the numbers that are also in `other`
+     */
+    value_range& intersect(const value_range& other) {
+        if (other.lo > lo || (other.lo == lo && other.lo_open)) {
+            lo = other.lo;
+            lo_open = other.lo_open;
+        }
+        if (other.hi < hi || (other.hi == hi && other.hi_open)) {
+            hi = other.hi;
+            hi_open = other.hi_open;
+        }
+        return *this;
+    }
+};
+
+/**
+     * @brief Minimum and maximum of the valid values of a `%le` or `%d` column in every zone of
+     * `ZONE_ROWS` rows, and whether the whole column is sorted (ascending, no null and no NaN).
+     *
+     * Built for one column, like `trigram_index` it's up to the owner to use it with that column only.
+     */
+class zone_map {
+public:
+    zone_map() = default;
+
+    template<typename real>
+    static zone_map build(const data_vector<real>& column) {
+        zone_map zones;
+        zones.row_count = column.size();
+        with_values(column, [&](auto& values) {
+            const size_t count = (values.size() + ZONE_ROWS - 1) / ZONE_ROWS;
+            zones.mins.assign(count, std::numeric_limits<double>::infinity());
+            zones.maxs.assign(count, -std::numeric_limits<double>::infinity());
+            zones.has_nan.assign(count, 0);
+            zones.sorted = !column.validity_mask();
+            double previous = -std::numeric_limits<double>::infinity();
+            for (size_t i = 0; i < values.size(); i++) {
+                const double x = static_cast<double>(values[i]);
+                const size_t zone = i / ZONE_ROWS;
+                if (std::isnan(x)) {
+                    zones.has_nan[zone] = 1;
+                    zones.sorted = false;
+                    continue;
+                }
+                if (x < previous)
+                    zones.sorted = false;
+                previous = x;
+                if (!column.is_valid(i)) continue;
+                zones.mins[zone] = std::min(zones.mins[zone], x);
+                zones.maxs[zone] = std::max(zones.maxs[zone], x);
+            }
+        });
+        return zones;
+    }
+
+    size_t size() const { return row_count; }
+    size_t zone_count() const { return mins.size(); }
+    bool is_sorted() const { return sorted; }
+
+    /**
+     * @brief The rows of `column` (the column the map has been built for) with a value in
+     * `range`. Null cells are not taken out, the caller masks them with the validity bitmap.
+     */
+    template<typename real>
+    bitmap select(const data_vector<real>& column, const value_range& range) const {
+        if (column.size() != row_count)
+            throw std::runtime_error("zone map doesn't fit column " + column.get_name());
+        bitmap result(row_count);
+        with_values(column, [&](auto& values) {
+            if (sorted) {
+                auto first = std::partition_point(values.begin(), values.end(),
+                                                  [&](auto x) { return range.below(static_cast<double>(x)); });
+                auto last = std::partition_point(first, values.end(),
+                                                 [&](auto x) { return !range.above(static_cast<double>(x)); });
+                result.set_range(first - values.begin(), last - values.begin());
+                return;
+            }
+
+            bitmap::word_t* words = result.data();
+            for (size_t zone = 0; zone < mins.size(); zone++) {
+                if (!range.overlaps(mins[zone], maxs[zone])) continue;
+                const size_t first = zone * ZONE_ROWS;
+                const size_t last = std::min(row_count, first + ZONE_ROWS);
+                if (!has_nan[zone] && range.contains(mins[zone]) && range.contains(maxs[zone])) {
+                    result.set_range(first, last);
+                    continue;
+                }
+                // the ends of the range decide the comparisons once per zone, not per row
+                auto compare = [&](auto in_range) {
+                    for (size_t w = first / bitmap::WORD_BITS; w < bitmap::word_count(last); w++) {
+                        const size_t begin = w * bitmap::WORD_BITS;
+                        const size_t n = std::min(bitmap::WORD_BITS, last - begin);
+                        bitmap::word_t word = 0;
+                        for (size_t k = 0; k < n; k++)
+                            word |= bitmap::word_t(in_range(static_cast<double>(values[begin + k]))) << k;
+                        words[w] = word;
+                    }
+                };
+                const double lo = range.lo, hi = range.hi;
+                if (range.lo_open && range.hi_open)
+                    compare([=](double x) { return (x > lo) & (x < hi); });
+                else if (range.lo_open)
+                    compare([=](double x) { return (x > lo) & (x <= hi); });
+                else if (range.hi_open)
+                    compare([=](double x) { return (x >= lo) & (x < hi); });
+                else
+                    compare([=](double x) { return (x >= lo) & (x <= hi); });
+            }
+        });
+        return result;
+    }
+
+    /**
+     * @brief Bytes allocated for the zones
+     */
+    size_t memory_usage() const {
+        return (mins.capacity() + maxs.capacity()) * sizeof(double) + has_nan.capacity();
+    }
+
+private:
+    std::vector<double> mins;
+    std::vector<double> maxs;
+    std::vector<uint8_t> has_nan;
+    bool sorted = false;
+    size_t row_count = 0;
+
+    // calls `fn` with the values of a `%le` or `%d` column
+    template<typename real, typename F>
+    static void with_values(const data_vector<real>& column, F&& fn) {
+        switch (column.get_type()) {
+        case DataType::LE:
+            fn(column.as_double_vector());
+            break;
+        case DataType::D:
+            fn(column.as_int_vector());
+            break;
+        default:
+            throw std::runtime_error("zone maps are only built for %le and %d columns");
+        }
+    }
+};
+}  // namespace tfs
@@ -3,6 +3,7 @@
 
 #include <QVariant>
 #include "tfs_dataframe.h"
+#include "tfs_edit.h"
 
 template<typename real>
 QVariant data_value_to_qvariant(const tfs::data_value<real>& value) {
@@ -13,9 +14,85 @@ QVariant data_value_to_qvariant(const tfs::data_value<real>& value) {
         return value.get_double();
     case tfs::DataType::D:
         return value.get_int();
+    case tfs::DataType::B:
+        return value.get_bool();
+    case tfs::DataType::C:
+        return QString::fromStdString(value.pretty_print());
     default:
         return QVariant();
     }
 }
 
+/**
+ * @brief The `row`th cell of `column` as QVariant, for display.
+ * Null cells are empty.
+ */
+template<typename real>
+QVariant column_loc(const tfs::data_vector<real>& column, size_t row) {
+    if (!column.is_valid(row))
+        return QVariant();
+    switch (column.get_type()) {
+    case tfs::DataType::S:
+    {
+        auto str = column.as_string_vector()[row];
+        return QString::fromUtf8(str.data(), static_cast<int>(str.size()));
+    }
+    case tfs::DataType::LE:
+        return static_cast<double>(column.as_double_vector()[row]);
+    case tfs::DataType::D:
+        return column.as_int_vector()[row];
+    case tfs::DataType::B:
+        return column.as_bool_vector()[row];
+    case tfs::DataType::C:
+    {
+        std::string str;
+        tfs::helper::append_complex(str, column.as_complex_vector()[row], 0);
+        return QString::fromStdString(str);
+    }
+    default:
+        return QVariant();
+    }
+}
+
+/**
+ * @brief Magnitude and phase of the `row`th cell of `column` if it is complex,
+ * an empty QVariant otherwise.
+ */
+template<typename real>
+QVariant column_loc_polar(const tfs::data_vector<real>& column, size_t row) {
+    if (column.get_type() != tfs::DataType::C || !column.is_valid(row))
+        return QVariant();
+    auto value = column.as_complex_vector()[row];
+    return QString("|z| = %1, arg(z) = %2")
+            .arg(static_cast<double>(std::abs(value)))
+            .arg(static_cast<double>(std::arg(value)));
+}
+
+/**
+ * @brief The cell at `row`, `column` of `df` as QVariant, for display.
+ */
+template<typename real>
+QVariant df_loc(const tfs::dataframe<real>& df, size_t row, int column) {
+    return column_loc(df.get_column(static_cast<size_t>(column)), row);
+}
+
+/**
+ * @brief The cell at `row`, `column` of the edited dataframe as QVariant, for display.
+ */
+template<typename real>
+QVariant df_loc(const tfs::edit_session<real>& session, size_t row, int column) {
+    return session.with_cell(row, static_cast<size_t>(column),
+                             [](auto& c, size_t i) { return column_loc(c, i); });
+}
+
+/**
+ * @brief Magnitude and phase of the cell at `row`, `column` of the edited dataframe
+ * if it is complex, an empty QVariant otherwise.
+ */
+template<typename real>
+QVariant df_loc_polar(const tfs::edit_session<real>& session, size_t row, int column) {
+    return session.with_cell(row, static_cast<size_t>(column),
+                             [](auto& c, size_t i) { return column_loc_polar(c, i); });
+}
+
 #endif // TFSHELPER_H
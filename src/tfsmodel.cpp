@@ -1,4 +1,8 @@
 #include "tfsmodel.h"
+#include "tfshelper.h"
+#include <QDebug>
+#include <QRegularExpression>
+#include <algorithm>
 
 //TFSModel::TFSModel()
 //    :df(nullptr),
@@ -8,62 +12,253 @@
 //
 //}
 
-TFSModel::TFSModel(tfs::dataframe<double> *dataframe)
-    : df(dataframe)
+TFSModel::TFSModel(AnyEditSession session)
+    : session(session)
+    , df(session.snapshot())
     , is_filtering(false)
-    , filterworker(new QFilterWorker(dataframe))
-    , accepted_rows(nullptr)
-    , workerthread()
+    , is_partial(false)
+    , filter_generation(std::make_shared<std::atomic<quint64>>(0))
+    , filterworker(new QFilterWorker(filter_generation))
+    , accepted_rows()
+    , filter_mode(FilterMode::Regex)
+    , workerthread(new QThread)
 {
+    qRegisterMetaType<AnyDataframe>();
+    qRegisterMetaType<QFilterWorker::rows_t>();
+    qRegisterMetaType<QFilterWorker::ranking_t>();
+    qRegisterMetaType<FilterRequest>();
 
     connect(this, &TFSModel::request_filter, filterworker, &QFilterWorker::filter);
-    connect(filterworker, &QFilterWorker::done_filtering, this, &TFSModel::receive_indices);
+    connect(filterworker, &QFilterWorker::done_filtering, this, &TFSModel::receive_rows);
+    connect(filterworker, &QFilterWorker::partial_results, this, &TFSModel::receive_partial_rows);
+    connect(filterworker, &QFilterWorker::done_ranking, this, &TFSModel::receive_ranking);
 
-    filterworker->moveToThread(&workerthread);
-    workerthread.start();
+    // the worker gets its own snapshot with every request, so it may finish a running
+    // search after the model is gone. Worker and thread clean up after themselves.
+    connect(workerthread, &QThread::finished, filterworker, &QObject::deleteLater);
+    connect(workerthread, &QThread::finished, workerthread, &QObject::deleteLater);
+
+    filterworker->moveToThread(workerthread);
+    workerthread->start();
+
+    debounce.setSingleShot(true);
+    debounce.setInterval(0);
+    connect(&debounce, &QTimer::timeout, this, [this]() {
+        FilterRequest request{pending_pattern, filter_mode, session.snapshot()};
+        if (filter_mode == FilterMode::Fuzzy) {
+            emit request_filter(request, *filter_generation);
+            emit filter_progress(0, false);
+            return;
+        }
+        // globs are never queries, and match whole cells: more characters don't narrow them down
+        if (filter_mode == FilterMode::Regex) {
+            QString error;
+            request.query = parse_query(pending_pattern, &error);
+            // most likely meant as query, tell why it is searched for as regular expression
+            if (!request.query && pending_pattern.contains(QRegularExpression("&&|[<>=~]")))
+                qWarning() << "not a query (" << error << "), searching for it as regular expression";
+            // a pattern that narrows a cached one only needs to look at the rows found for that
+            // (unless that was a query, which only looked at some of the columns)
+            for (auto& entry : filter_cache)
+                if (!request.query && QFilterWorker::narrows(entry.first, pending_pattern) && !parse_query(entry.first)
+                        && (!request.candidates || entry.second->count() < request.candidates->count()))
+                    request.candidates = entry.second;
+        }
+        if (!request.query)
+            request.index = trigram_index;
+        emit request_filter(request, *filter_generation);
+        emit filter_progress(0, false);
+    });
 }
 
 TFSModel::~TFSModel()
 {
-    delete filterworker;
-    workerthread.quit();
-    workerthread.wait();
+    // stops a running search
+    ++*filter_generation;
+    workerthread->quit();
 }
 
 void TFSModel::filter(const QString &pattern)
 {
+    // whatever is still running or waiting is for an outdated pattern
+    ++*filter_generation;
+    pending_pattern = pattern;
+
+    is_partial = false;
+
     if (pattern.isEmpty())
     {
+        debounce.stop();
+        beginResetModel();
         is_filtering = false;
+        accepted_rows.reset();
+        ranked_rows.reset();
         endResetModel();
         return;
     }
 
+    // seen recently (e.g. after backspace): no need to search (never the case in fuzzy mode,
+    // rankings aren't cached)
+    auto cached = std::find_if(filter_cache.begin(), filter_cache.end(),
+                               [&](auto& entry) { return entry.first == pattern; });
+    if (cached != filter_cache.end()) {
+        debounce.stop();
+        auto rows = cached->second;
+        cache_result(pattern, rows);
+        show_rows(rows);
+        emit filter_progress(static_cast<int>(rows->count()), true);
+        return;
+    }
+
+    // the view keeps the rows of the last search until the first matches come in
+    debounce.start();
+}
+
+void TFSModel::cache_result(const QString &pattern, QFilterWorker::rows_t rows)
+{
+    filter_cache.erase(std::remove_if(filter_cache.begin(), filter_cache.end(),
+                                      [&](auto& entry) { return entry.first == pattern; }),
+                       filter_cache.end());
+    filter_cache.insert(filter_cache.begin(), {pattern, std::move(rows)});
+    if (filter_cache.size() > FILTER_CACHE_SIZE)
+        filter_cache.pop_back();
+}
+
+QFilterWorker::query_t TFSModel::parse_query(const QString &pattern, QString *error) const
+{
+    try {
+        return df.visit([&](auto& dataframe) {
+            return std::make_shared<const tfs::query>(tfs::query::parse(pattern.toStdString(), dataframe));
+        });
+    }
+    catch (const std::runtime_error& e) {
+        if (error) *error = QString::fromStdString(e.what());
+        return nullptr;
+    }
+}
+
+void TFSModel::show_rows(QFilterWorker::rows_t rows)
+{
+    beginResetModel();
     is_filtering = true;
-    auto index_buffer = new std::vector<size_t>;
-    index_buffer->reserve(df->size());
-    emit request_filter(pattern, index_buffer);
+    accepted_rows = std::move(rows);
+    ranked_rows.reset();
+    endResetModel();
+}
+
+void TFSModel::append_rows(QFilterWorker::rows_t rows)
+{
+    // the rows before the new ones are the same, they only need to be added at the end
+    const int shown = static_cast<int>(accepted_rows->count());
+    if (static_cast<int>(rows->count()) > shown) {
+        beginInsertRows(QModelIndex(), shown, static_cast<int>(rows->count()) - 1);
+        accepted_rows = std::move(rows);
+        endInsertRows();
+    }
+    else
+        accepted_rows = std::move(rows);
+}
+
+void TFSModel::set_debounce(int msec)
+{
+    debounce.setInterval(msec);
+}
+
+void TFSModel::set_index(QFilterWorker::index_t index)
+{
+    trigram_index = std::move(index);
+}
+
+void TFSModel::set_filter_mode(FilterMode mode)
+{
+    if (mode == filter_mode) return;
+    filter_mode = mode;
+    // the same pattern finds other rows now
+    filter_cache.clear();
+    if (!pending_pattern.isEmpty())
+        filter(pending_pattern);
+}
+
+QFilterWorker::rows_t TFSModel::shown_rows() const
+{
+    return is_filtering ? accepted_rows : nullptr;
+}
+
+size_t TFSModel::source_row(int view_row) const
+{
+    if (ranked_rows)
+        return (*ranked_rows)[static_cast<size_t>(view_row)];
+    return is_filtering ? accepted_rows->select(static_cast<size_t>(view_row)) : static_cast<size_t>(view_row);
+}
+
+int TFSModel::view_row(size_t row) const
+{
+    if (!is_filtering)
+        return static_cast<int>(row);
+    if (ranked_rows) {
+        auto it = std::find(ranked_rows->begin(), ranked_rows->end(), row);
+        return it == ranked_rows->end() ? -1 : static_cast<int>(it - ranked_rows->begin());
+    }
+    return accepted_rows->contains(row) ? static_cast<int>(accepted_rows->rank(row)) : -1;
+}
+
+void TFSModel::receive_partial_rows(QFilterWorker::rows_t rows, quint64 generation)
+{
+    if (generation != *filter_generation) return;
+    // the first batch replaces the rows of the last search, later ones are appended
+    if (is_partial)
+        append_rows(rows);
+    else
+        show_rows(rows);
+    is_partial = true;
+    emit filter_progress(static_cast<int>(rows->count()), false);
 }
 
-void TFSModel::receive_indices(std::vector<size_t>* buf)
+void TFSModel::receive_rows(QFilterWorker::rows_t rows, quint64 generation)
 {
-    // if buf is nullptr, filtering failed and we don't update the model
-    if (!buf) return;
-    // accepted_rows will be replace, so trash the old one
-    if (accepted_rows)
-        delete accepted_rows;
-    // replace old accepted_row with new one
-    accepted_rows = buf;
-    // and finally, request redraw
+    // results for an older pattern
+    if (generation != *filter_generation) return;
+    // if rows is nullptr, filtering failed and we don't update the model
+    if (!rows) {
+        emit filter_failed();
+        return;
+    }
+    cache_result(pending_pattern, rows);
+    if (is_partial)
+        append_rows(rows);
+    else
+        show_rows(rows);
+    is_partial = false;
+    emit filter_progress(static_cast<int>(rows->count()), true);
+}
+
+void TFSModel::receive_ranking(QFilterWorker::ranking_t ranking, quint64 generation)
+{
+    if (generation != *filter_generation) return;
+    if (!ranking) {
+        emit filter_failed();
+        return;
+    }
+    // plots and exports take the same rows as bitmap
+    tfs::bitmap rows(df.size());
+    for (size_t row : *ranking)
+        rows.set(row);
+
+    beginResetModel();
+    is_filtering = true;
+    accepted_rows = std::make_shared<const tfs::row_set>(std::move(rows));
+    ranked_rows = std::move(ranking);
     endResetModel();
+    is_partial = false;
+    emit filter_progress(static_cast<int>(ranked_rows->size()), true);
 }
 
 QModelIndex TFSModel::index(int row, int column, const QModelIndex &parent) const
 {
     if (
-        row > static_cast<int>(df->size())
-        || column > df->column_count()
-        || !df
+        df.is_null()
+        || row > static_cast<int>(df.size())
+        || column > static_cast<int>(df.column_count())
         ) return QModelIndex();
     return createIndex(row, column);
 }
@@ -75,42 +270,108 @@ QModelIndex TFSModel::parent(const QModelIndex &child) const
 
 int TFSModel::rowCount(const QModelIndex &parent) const
 {
-    if (!df) return 0;
-    if (is_filtering) return static_cast<int>(accepted_rows->size());
-    return static_cast<int>(df->size());
+    if (df.is_null()) return 0;
+    if (ranked_rows) return static_cast<int>(ranked_rows->size());
+    if (is_filtering) return static_cast<int>(accepted_rows->count());
+    return static_cast<int>(df.size());
 }
 
 int TFSModel::columnCount(const QModelIndex &parent) const
 {
-    if (!df) return 0;
-    return static_cast<int>(df->column_count());
+    if (df.is_null()) return 0;
+    return static_cast<int>(df.column_count());
 }
 
 QVariant TFSModel::data(const QModelIndex &index, int role) const
 {
     switch (role) {
         case Qt::DisplayRole:
+        case Qt::EditRole:
         {
 
-        return is_filtering ?
-                df_loc(*df, (*accepted_rows)[index.row()], index.column()) :
-                df_loc(*df, index.row(), index.column());
+        const size_t row = source_row(index.row());
+        return session.visit([&](auto& s) { return df_loc(s, row, index.column()); });
+        }
+    case Qt::ToolTipRole:
+        {
+        const size_t row = source_row(index.row());
+        return session.visit([&](auto& s) { return df_loc_polar(s, row, index.column()); });
         }
     default:
         return QVariant();
     }
 }
 
+Qt::ItemFlags TFSModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+    return QAbstractItemModel::flags(index) | Qt::ItemIsEditable;
+}
+
+bool TFSModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (role != Qt::EditRole || !index.isValid())
+        return false;
+
+    const size_t row = source_row(index.row());
+    const auto text = value.toString().trimmed().toStdString();
+    bool ok = false;
+    try {
+        ok = session.visit([&](auto& s) { return s.set_from_string(row, index.column(), text); });
+    }
+    catch (const std::exception& e) {
+        qWarning() << "failed editing cell: " << QString::fromStdString(e.what());
+        return false;
+    }
+    if (!ok) {
+        qWarning() << "can't parse" << value.toString() << "as" << tfs::string_fromDT(df.column_type(index.column()));
+        return false;
+    }
+
+    filter_cache.clear();
+    emit dataChanged(index, index);
+    emit edited();
+    return true;
+}
+
+bool TFSModel::undo()
+{
+    if (!session.can_undo()) return false;
+    const size_t row = session.visit([](auto& s) { return s.undo(); });
+    filter_cache.clear();
+    changed_row(row);
+    emit edited();
+    return true;
+}
+
+bool TFSModel::redo()
+{
+    if (!session.can_redo()) return false;
+    const size_t row = session.visit([](auto& s) { return s.redo(); });
+    filter_cache.clear();
+    changed_row(row);
+    emit edited();
+    return true;
+}
+
+void TFSModel::changed_row(size_t row)
+{
+    // the view keeps its rows until the next search, whether they still match or not
+    const int shown = view_row(row);
+    if (shown >= 0)
+        emit dataChanged(index(shown, 0, QModelIndex()), index(shown, columnCount(QModelIndex()) - 1, QModelIndex()));
+}
+
 QVariant TFSModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
     switch (role) {
     case Qt::DisplayRole:
     {
         if (orientation == Qt::Orientation::Horizontal) {
-            if (section >= df->column_count())
+            if (section >= static_cast<int>(df.column_count()))
                 return QVariant();
-            auto retval = QString::fromStdString(this->df->get_column(section).get_name());
-            return retval;
+            return df.column_name(section);
         }
         else {
             return section;
@@ -119,17 +380,3 @@ QVariant TFSModel::headerData(int section, Qt::Orientation orientation, int role
     }
     return QVariant();
 }
-
-QVariant df_loc(const tfs::dataframe<double> &df, int row, int column)
-{
-    auto& _column = const_cast<tfs::data_vector<double>&>(df.get_column(static_cast<size_t>(column)));
-    auto _row = static_cast<size_t>(row);
-    switch (_column.get_type()) {
-    case tfs::DataType::S:
-        return QString::fromStdString(_column.as_string_vector()[_row]);
-    case tfs::DataType::LE:
-        return _column.as_double_vector()[_row];
-    default:
-        return QVariant();
-    }
-}
@@ -3,14 +3,19 @@
 
 #include "qabstractitemmodel.h"
 
-#include <regex>
+#include <atomic>
+#include <memory>
 #include <QThread>
+#include <QTimer>
 
-#include "tfs_dataframe.h"
+#include "anydataframe.h"
+#include "anyeditsession.h"
 #include "qfilterworker.h"
 
-QVariant df_loc(const tfs::dataframe<double>& df, int row, int column);
-
+/**
+ * @brief Number of search results kept by `TFSModel` for backspacing and refining
+ */
+constexpr size_t FILTER_CACHE_SIZE = 8;
 
 class TFSModel : public QAbstractItemModel
 {
@@ -19,16 +24,74 @@ class TFSModel : public QAbstractItemModel
 public:
     //TFSModel();
 
-    TFSModel(tfs::dataframe<double> *dataframe);
+    TFSModel(AnyEditSession session);
     ~TFSModel();
 
+    /**
+     * @brief Shows only the rows matching `pattern` (all rows if it is empty).
+     * Runs in the background, a newer pattern cancels the search for the older one.
+     */
     void filter(const QString& pattern);
 
+    /**
+     * @brief Waits until `pattern` hasn't changed for `msec` before searching, 0 searches right away
+     */
+    void set_debounce(int msec);
+
+    /**
+     * @brief Uses `index` to narrow down searches (see `tfs::trigram_index`), nullptr to search without
+     */
+    void set_index(QFilterWorker::index_t index);
+
+    /**
+     * @brief How patterns are searched for, searches again for the current pattern
+     */
+    void set_filter_mode(FilterMode mode);
+
+    /**
+     * @brief The rows shown by the view, nullptr if all rows are shown. In file order, also
+     * if the view shows them ranked.
+     */
+    QFilterWorker::rows_t shown_rows() const;
+
+    /**
+     * @brief The row of the dataframe shown in `view_row`
+     */
+    size_t source_row(int view_row) const;
+
+    /**
+     * @brief Where the dataframe row `row` is shown, -1 if it is filtered out
+     */
+    int view_row(size_t row) const;
+
+    /**
+     * @brief Reverts / repeats the last edit. Return false if there was nothing to undo / redo.
+     */
+    bool undo();
+    bool redo();
+
 signals:
-    void request_filter(const QString& pattern, std::vector<size_t>* buf);
+    void request_filter(const FilterRequest& request, quint64 generation);
+
+    /**
+     * @brief Emitted after a cell has been edited, or an edit undone / redone
+     */
+    void edited();
+
+    /**
+     * @brief Number of matches shown while a search runs (`finished` false), and once it is done
+     */
+    void filter_progress(int matches, bool finished);
+
+    /**
+     * @brief Emitted if the pattern can't be searched for (e.g. an invalid regular expression)
+     */
+    void filter_failed();
 
 public slots:
-    void receive_indices(std::vector<size_t>* buf);
+    void receive_rows(QFilterWorker::rows_t rows, quint64 generation);
+    void receive_partial_rows(QFilterWorker::rows_t rows, quint64 generation);
+    void receive_ranking(QFilterWorker::ranking_t ranking, quint64 generation);
 
 public:
     QModelIndex index(int row, int column, const QModelIndex &parent) const;
@@ -36,19 +99,56 @@ public:
     int rowCount(const QModelIndex &parent) const;
     int columnCount(const QModelIndex &parent) const;
     QVariant data(const QModelIndex &index, int role) const;
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    bool setData(const QModelIndex &index, const QVariant &value, int role);
 
     // QAbstractItemModel interface
 public:
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
 
 private:
-    tfs::dataframe<double> *df;
+    AnyEditSession session;
+    // the dataframe as loaded, edits don't change its shape
+    AnyDataframe df;
 
+    // whether `accepted_rows` is set, and shown instead of all rows
     bool is_filtering;
+    // whether `accepted_rows` are the partial results of the running search
+    bool is_partial;
+    // counted up with every pattern, results of older generations are thrown away
+    std::shared_ptr<std::atomic<quint64>> filter_generation;
+    QString pending_pattern;
+    QTimer debounce;
     QFilterWorker *filterworker;
-    std::vector<size_t> *accepted_rows;
+    QFilterWorker::rows_t accepted_rows;
+    // the order `accepted_rows` are shown in after a fuzzy search, nullptr for file order
+    QFilterWorker::ranking_t ranked_rows;
+    QFilterWorker::index_t trigram_index;
+    FilterMode filter_mode;
+
+    // results of the latest searches, most recent first. Cleared on every edit and when the
+    // mode changes, fuzzy searches aren't kept
+    std::vector<std::pair<QString, QFilterWorker::rows_t>> filter_cache;
+
+    void cache_result(const QString& pattern, QFilterWorker::rows_t rows);
+
+    /**
+     * @brief `pattern` as query (see tfs_query.h), nullptr (and why in `error`) if it isn't one
+     */
+    QFilterWorker::query_t parse_query(const QString& pattern, QString* error = nullptr) const;
+    void show_rows(QFilterWorker::rows_t rows);
+
+    /**
+     * @brief Shows `rows`, which start with the rows shown now
+     */
+    void append_rows(QFilterWorker::rows_t rows);
+
+    /**
+     * @brief Updates the view of the dataframe row `row`, if it is shown
+     */
+    void changed_row(size_t row);
     //std::vector<size_t> *index_buffer;
-    QThread workerthread;
+    QThread *workerthread;
 
 };
 
@@ -18,7 +18,7 @@ QModelIndex TfsPropertyModel::parent(const QModelIndex &child) const
 
 int TfsPropertyModel::rowCount(const QModelIndex &parent) const
 {
-    return df->property_count();
+    return static_cast<int>(df.property_count());
 }
 
 int TfsPropertyModel::columnCount(const QModelIndex &parent) const
@@ -30,15 +30,18 @@ QVariant TfsPropertyModel::data(const QModelIndex &index, int role) const
 {
     switch (role) {
     case Qt::DisplayRole:
-        auto& p = df->get_property(index.row());
-        switch (index.column()) {
-        case 0:
-            return QString::fromStdString(p.name);
-        case 1:
-            return QString::fromStdString(tfs::string_fromDT(p.value.type));
-        case 2:
-            return data_value_to_qvariant(p.value);
-        }
+        return df.visit([&](auto& dataframe) -> QVariant {
+            auto& p = dataframe.get_property(index.row());
+            switch (index.column()) {
+            case 0:
+                return QString::fromStdString(p.name);
+            case 1:
+                return QString::fromStdString(tfs::string_fromDT(p.value.type));
+            case 2:
+                return data_value_to_qvariant(p.value);
+            }
+            return QVariant();
+        });
     }
 
     return QVariant();
@@ -2,14 +2,14 @@
 #define TFSPROPERTYMODEL_H
 
 #include <qabstractitemmodel.h>
-#include "tfs_dataframe.h"
+#include "anydataframe.h"
 
 class TfsPropertyModel : public QAbstractItemModel
 {
-   tfs::dataframe<double> *df;
+   AnyDataframe df;
 public:
     TfsPropertyModel();
-    TfsPropertyModel(tfs::dataframe<double>* df)
+    TfsPropertyModel(AnyDataframe df)
         : df(df) {}
 
     // QAbstractItemModel interface
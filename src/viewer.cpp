@@ -3,11 +3,50 @@
 #include <qdebug.h>
 
 #include <qfiledialog.h>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+#include <QSettings>
+#include <QMessageBox>
+#include <QInputDialog>
+#include <memory_resource>
 #include "tfsmodel.h"
+#include "memorydialog.h"
 #include "darkstyle.h"
 
 QStringListModel message_model;
 
+/**
+ * @brief Memory pool for column data, shared by all files opened in this session.
+ * Memory of closed files goes back to the pool and is reused for the next file instead of
+ * being returned to the system. Buffers above 1 MiB go straight to the heap.
+ *
+ * Never deleted: columns may be released by worker threads until the very end.
+ */
+std::pmr::memory_resource* column_pool()
+{
+    static auto pool = new std::pmr::synchronized_pool_resource(std::pmr::pool_options{0, 1 << 20});
+    return pool;
+}
+
+/**
+ * @brief Loads `filename`. Binary files may come with a trigram index, which is put into `index`.
+ */
+template<typename real>
+std::shared_ptr<const tfs::dataframe<real>> load_dataframe(const QString& filename, QFilterWorker::index_t& index)
+{
+    if (filename.endsWith(".btfs"))
+    {
+        auto dataframe = std::make_shared<tfs::dataframe<real>>(column_pool());
+        std::ifstream stream(filename.toStdString(), std::ios::binary);
+        dataframe->load_from_binary(stream);
+        auto stored = std::make_shared<tfs::trigram_index>();
+        if (tfs::trigram_index::read_from_binary(stream, *dataframe, *stored))
+            index = stored;
+        return dataframe;
+    }
+    return std::make_shared<tfs::dataframe<real>>(filename.toStdString(), "", column_pool());
+}
+
 
 
 
@@ -65,9 +104,12 @@ void Viewer::setPlotStyles()
 Viewer::Viewer(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::Viewer)
-    , df(nullptr)
+    , df()
     , model(nullptr)
     , prop_model(nullptr)
+    , memory_label(nullptr)
+    , filter_label(nullptr)
+    , index_outdated(false)
 {
     qDebug() << "about to start main window";
     ui->setupUi(this);
@@ -93,12 +135,23 @@ Viewer::Viewer(QWidget *parent)
     connect(search, &QAction::triggered, this, &Viewer::jump_to_search);
     this->addAction(search);
 
+    connect(&stats_watcher, &QFutureWatcher<tfs::column_stats>::finished, this, &Viewer::receive_column_stats);
+
+    filter_label = new QLabel(this);
+    ui->statusbar->addPermanentWidget(filter_label);
+    memory_label = new QLabel(this);
+    ui->statusbar->addPermanentWidget(memory_label);
+
+    connect(&index_watcher, &QFutureWatcher<QFilterWorker::index_t>::finished, this, &Viewer::receive_index);
+    ui->actionIndexStrings->setChecked(QSettings().value("filter/trigram_index", false).toBool());
+    ui->filterModeBox->setCurrentIndex(QSettings().value("filter/mode", 0).toInt());
+
 }
 
 Viewer::~Viewer()
 {
     delete ui;
-    delete df;
+    df.reset();
     if (model)
         delete model;
     if (prop_model)
@@ -114,20 +167,27 @@ void Viewer::on_actionOpen_triggered()
 
 }
 
-void Viewer::set_chart(const std::string &name, const std::vector<double> &points)
+template<typename real>
+void Viewer::set_chart(const std::string &name, const tfs::column_storage<real> &points, const tfs::bitmap* valid)
 {
-    QVector<double> x(points.size());
-    QVector<double> y(points.size());
+    QVector<double> x;
+    QVector<double> y;
+    x.reserve(static_cast<int>(points.size()));
+    y.reserve(static_cast<int>(points.size()));
 
     double min_x, max_x, min_y = 1.0e12, max_y = 1.0e-12;
 
-    for (size_t i = 0; i < points.size(); i++) {
-        x[i] = i;
-        y[i] = points[i];
+    auto add_point = [&](size_t i) {
+        x.push_back(i);
+        y.push_back(points[i]);
 
-        min_y = y[i] < min_y ? y[i] : min_y;
-        max_y = y[i] > max_y ? y[i] : max_y;
-    }
+        min_y = y.back() < min_y ? y.back() : min_y;
+        max_y = y.back() > max_y ? y.back() : max_y;
+    };
+    if (valid)
+        valid->for_each_set(add_point);
+    else
+        for (size_t i = 0; i < points.size(); i++) add_point(i);
 
     min_x = 0;
     max_x = points.size();
@@ -181,26 +241,71 @@ void Viewer::set_chart(const std::string &name,
 
 }
 
-void Viewer::set_chart(const tfs::data_vector<double> &x, const QVector<const tfs::data_vector<double> *> &y)
+template<typename real>
+const tfs::column_storage<real>* Viewer::plot_values(const tfs::data_vector<real>& column,
+                                                     tfs::column_storage<real>& buffer) const
+{
+    switch (column.get_type()) {
+    case tfs::DataType::LE:
+        return &column.as_double_vector();
+    case tfs::DataType::C:
+        buffer = ui->actionPlotComplexPhase->isChecked()
+                ? column.as_complex_vector().phase()
+                : column.as_complex_vector().magnitude();
+        return &buffer;
+    default:
+        return nullptr;
+    }
+}
+
+QString Viewer::plot_label(const std::string& name, tfs::DataType type) const
+{
+    auto label = QString::fromStdString(name);
+    if (type != tfs::DataType::C)
+        return label;
+    return ui->actionPlotComplexPhase->isChecked()
+            ? QString("arg(%1)").arg(label)
+            : QString("|%1|").arg(label);
+}
+
+template<typename real>
+void Viewer::set_chart(const tfs::data_vector<real> &x, const QVector<const tfs::data_vector<real> *> &y,
+                       const tfs::bitmap* shown)
 {
     ui->actionplotColumn->setChecked(true);
     ui->actionscatter_plot_column->setChecked(false);
-    if (x.get_type() != tfs::DataType::LE) return;
+    tfs::column_storage<real> x_buffer, y_buffer;
+    auto x_values = plot_values(x, x_buffer);
+    if (!x_values) return;
     ui->customPlot->clearGraphs();
-    QVector<double> x_(x.size());
-    for (double d : x.as_double_vector())
-        x_.push_back(d);
+    const auto& x_ = *x_values;
     int clr_index = 0;
     for (auto y_ : y) {
-        if (y_->get_type() != tfs::DataType::LE) continue;
-
-        QVector<double> y_values(y_->size());
-        for (double d : y_->as_double_vector())
-            y_values.push_back(d);
+        auto values = plot_values(*y_, y_buffer);
+        if (!values) continue;
+
+        // fill the plot data straight from the column, whatever its precision
+        const auto& y_values = *values;
+        QVector<QCPGraphData> points;
+        if (!shown && !x.validity_mask() && !y_->validity_mask()) {
+            points.resize(static_cast<int>(std::min(x_.size(), y_values.size())));
+            for (int i = 0; i < points.size(); i++) {
+                points[i].key = x_[i];
+                points[i].value = y_values[i];
+            }
+        }
+        else {
+            // skip the rows where either value is null, or that are filtered out
+            auto valid = x.valid_rows() & y_->valid_rows();
+            if (shown)
+                valid &= *shown;
+            points.reserve(static_cast<int>(valid.count()));
+            valid.for_each_set([&](size_t i) { points.push_back(QCPGraphData(x_[i], y_values[i])); });
+        }
 
         auto graph = ui->customPlot->addGraph();
-        graph->setData(x_, y_values);
-        graph->setName(QString::fromStdString(y_->get_name()));
+        graph->data()->set(points);
+        graph->setName(plot_label(y_->get_name(), y_->get_type()));
         graph->setPen(plot_colors[clr_index]);
         clr_index = clr_index == (plot_colors.size() - 1) ? 0 : clr_index + 1;
     }
@@ -208,7 +313,7 @@ void Viewer::set_chart(const tfs::data_vector<double> &x, const QVector<const tf
     ui->customPlot->xAxis->rescale();
     ui->customPlot->yAxis->rescale();
     ui->customPlot->legend->setVisible(true);
-    ui->customPlot->xAxis->setLabel(QString::fromStdString(x.get_name()));
+    ui->customPlot->xAxis->setLabel(plot_label(x.get_name(), x.get_type()));
     ui->customPlot->replot();
     ui->chartArea->setVisible(true);
 
@@ -232,21 +337,36 @@ void Viewer::on_actionplotColumn_triggered()
     qDebug() << "try to plot";
     auto select = ui->tableView->selectionModel();
 
-    if (!select || !select->hasSelection()) {
+    if (!select || !select->hasSelection() || df.is_null()) {
         qDebug() << "no selection";
         return;
     }
-    if (select->selectedColumns().size() == 1) {
-        auto& col = df->get_column(select->selectedColumns()[0].column());
-        if (col.get_type() != tfs::DataType::LE) {
-            qDebug() << "plot works only with %le columns";
+    session.snapshot().visit([&](auto& dataframe) { plot_columns(dataframe, select->selectedColumns()); });
+}
+
+template<typename real>
+void Viewer::plot_columns(const tfs::dataframe<real>& dataframe, const QModelIndexList& columns)
+{
+    if (columns.size() == 1) {
+        auto& col = dataframe.get_column(columns[0].column());
+        tfs::column_storage<real> buffer;
+        auto values = plot_values(col, buffer);
+        if (!values) {
+            qDebug() << "plot works only with %le and %c columns";
             return;
         }
-       set_chart(col.get_name(), col.as_double_vector());
+       // only the rows shown in the table, and only those with a value
+       auto shown = model->shown_rows();
+       if (shown) {
+           auto rows = col.valid_rows() & shown->bits();
+           set_chart(plot_label(col.get_name(), col.get_type()).toStdString(), *values, &rows);
+       }
+       else
+           set_chart(plot_label(col.get_name(), col.get_type()).toStdString(), *values, col.validity_mask());
        qDebug() << "plotting successful";
     }
-    else if (select->selectedColumns().size() >= 2) {
-        auto& colx = df->get_column(select->selectedColumns()[0].column());
+    else if (columns.size() >= 2) {
+        auto& colx = dataframe.get_column(columns[0].column());
         /*
         QVector<QVector<double>> coly(select->selectedColumns().size()-1);
         for (int i = 1; i< select->selectedColumns().size(); i++)
@@ -267,18 +387,19 @@ void Viewer::on_actionplotColumn_triggered()
                  colx.payload.double_vector,
                  coly);
                  */
-        QVector<const tfs::data_vector<double>*> y_columns;
-        y_columns.reserve(select->selectedColumns().size());
-        for (int i = 1; i< select->selectedColumns().size(); i++) {
-            y_columns.push_back(&df->get_column(select->selectedColumns()[i].column()));
+        QVector<const tfs::data_vector<real>*> y_columns;
+        y_columns.reserve(columns.size());
+        for (int i = 1; i< columns.size(); i++) {
+            y_columns.push_back(&dataframe.get_column(columns[i].column()));
         }
 
-        set_chart(colx, y_columns);
+        auto shown = model->shown_rows();
+        set_chart(colx, y_columns, shown ? &shown->bits() : nullptr);
 
        qDebug() << "plotting successful";
     }
     else {
-        qDebug() << "wrong number of columns selected: " << select->selectedColumns().size();
+        qDebug() << "wrong number of columns selected: " << columns.size();
     }
 }
 
@@ -306,12 +427,32 @@ void Viewer::on_actionscatter_plot_column_triggered()
 
 void Viewer::on_actionSave_triggered()
 {
-    qWarning() << "save action not implemented yet";
+    if (df.is_null()) {
+        qWarning() << "no TFS dataframe open";
+        return;
+    }
+
+    auto filename = QFileDialog::getSaveFileName(this, tr("Save TFS file"),
+                                                 "", tr("TFS files (*.tfs *.dat)"));
+    if (filename.isEmpty()) {
+        qWarning() << "no filename selected. abort saving.";
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    try {
+        session.snapshot().visit([&](auto& dataframe) { dataframe.to_file(filename.toStdString()); });
+        qDebug() << "saved" << filename << "in" << timer.elapsed() << "ms";
+    }
+    catch (const std::exception& e) {
+        qWarning() << "failed saving tfs file: " << QString::fromStdString(e.what());
+    }
 }
 
 void Viewer::on_actionSave_Compressed_triggered()
 {
-    if (!df) {
+    if (df.is_null()) {
         qWarning() << "no TFS dataframe open";
         return;
     }
@@ -323,7 +464,44 @@ void Viewer::on_actionSave_Compressed_triggered()
         return;
     }
 
-    df->to_binary_file(filename.toStdString());
+    session.snapshot().visit([&](auto& dataframe) {
+        std::ofstream stream(filename.toStdString(), std::ios::binary | std::ios::trunc);
+        dataframe.write_to_binary(stream);
+        // the index is saved along, unless strings have been edited since it was built
+        if (index && index->covers(dataframe))
+            index->write_to_binary(stream);
+    });
+}
+
+void Viewer::on_actionExportShownRows_triggered()
+{
+    if (df.is_null()) {
+        qWarning() << "no TFS dataframe open";
+        return;
+    }
+
+    auto filename = QFileDialog::getSaveFileName(this, tr("Export shown rows"),
+                                                 "", tr("TFS files (*.tfs *.dat)"));
+    if (filename.isEmpty()) {
+        qWarning() << "no filename selected. abort exporting.";
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    auto shown = model->shown_rows();
+    try {
+        session.snapshot().visit([&](auto& dataframe) {
+            if (shown)
+                dataframe.select_rows(*shown).to_file(filename.toStdString());
+            else
+                dataframe.to_file(filename.toStdString());
+        });
+        qDebug() << "exported" << (shown ? shown->count() : df.size()) << "rows to" << filename << "in" << timer.elapsed() << "ms";
+    }
+    catch (const std::exception& e) {
+        qWarning() << "failed exporting rows: " << QString::fromStdString(e.what());
+    }
 }
 
 void Viewer::open_tfs(const QString &filename)
@@ -333,41 +511,249 @@ void Viewer::open_tfs(const QString &filename)
     if (QFile::exists(filename)) {
         qDebug() << "file exists";
 
-        if (df)
-            delete df;
+        if (!fits_memory_budget(filename))
+            return;
+
+        // the models and running jobs keep their own reference to the old dataframe
+        df.reset();
+        session = AnyEditSession();
+        index.reset();
 
-        if (filename.endsWith(".btfs"))
-        {
-            df = new tfs::dataframe<double>;
-            df->load_from_binary_file(filename.toStdString());
-        }
+        if (ui->actionReducedPrecision->isChecked())
+            df = load_dataframe<float>(filename, index);
         else
-            df = new tfs::dataframe<double>(filename.toStdString());
+            df = load_dataframe<double>(filename, index);
 
-        qDebug() << "tfs file loaded";
-        setWindowTitle(QString("TFS Viewer - %1").arg(QFileInfo(filename).fileName()));
+        qDebug() << "tfs file loaded" << (df.is_reduced_precision() ? "(reduced precision)" : "");
+        setWindowTitle(QString("TFS Viewer - %1%2")
+                       .arg(QFileInfo(filename).fileName())
+                       .arg(df.is_reduced_precision() ? " (float32)" : ""));
 
         if (model)
             delete model;
         if (prop_model)
             delete prop_model;
 
-        model = new TFSModel(df);
+        session = AnyEditSession(df);
+        model = new TFSModel(session);
+        model->set_debounce(QSettings().value("filter/debounce_ms", 100).toInt());
+        model->set_filter_mode(static_cast<FilterMode>(ui->filterModeBox->currentIndex()));
+        if (index)
+            qDebug() << "using the trigram index stored in" << filename;
+        model->set_index(index);
+        start_indexing();
         ui->tableView->setModel(model);
-        prop_model = new TfsPropertyModel(this->df);
+        connect(model, &TFSModel::edited, this, &Viewer::update_edit_actions);
+        connect(model, &TFSModel::edited, this, &Viewer::update_memory_label);
+        connect(model, &TFSModel::filter_progress, this, &Viewer::show_filter_progress);
+        connect(model, &TFSModel::filter_failed, this, [this]() { filter_label->setText(tr("invalid pattern")); });
+        filter_label->clear();
+        update_edit_actions();
+        update_memory_label();
+        prop_model = new TfsPropertyModel(df);
         ui->propertyTable->setModel(prop_model);
+
+        connect(ui->tableView->selectionModel(), &QItemSelectionModel::selectionChanged,
+                this, &Viewer::show_column_stats);
     }
 }
 
 
+void Viewer::on_actionUndo_triggered()
+{
+    if (model)
+        model->undo();
+}
+
+void Viewer::on_actionRedo_triggered()
+{
+    if (model)
+        model->redo();
+}
+
+void Viewer::update_edit_actions()
+{
+    ui->actionUndo->setEnabled(session.can_undo());
+    ui->actionRedo->setEnabled(session.can_redo());
+}
+
+bool Viewer::fits_memory_budget(const QString &filename)
+{
+    const qint64 budget = QSettings().value("memory/budget_mib", 0).toLongLong() * 1024 * 1024;
+    if (budget <= 0)
+        return true;
+
+    const size_t estimate = ui->actionReducedPrecision->isChecked()
+            ? tfs::dataframe<float>::estimate_memory_usage(filename.toStdString())
+            : tfs::dataframe<double>::estimate_memory_usage(filename.toStdString());
+    qDebug() << "estimated memory usage:" << MemoryDialog::format_size(estimate);
+    if (estimate <= static_cast<size_t>(budget))
+        return true;
+
+    return QMessageBox::warning(this, tr("Memory Budget"),
+                                tr("%1 will need about %2, more than the memory budget of %3.\nOpen it anyway?")
+                                .arg(QFileInfo(filename).fileName())
+                                .arg(MemoryDialog::format_size(estimate))
+                                .arg(MemoryDialog::format_size(static_cast<size_t>(budget))),
+                                QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::Yes;
+}
+
+void Viewer::on_actionMemoryUsage_triggered()
+{
+    MemoryDialog dialog(session.snapshot(), this);
+    dialog.exec();
+}
+
+void Viewer::on_actionMemoryBudget_triggered()
+{
+    QSettings settings;
+    bool ok = false;
+    const int budget = QInputDialog::getInt(this, tr("Memory Budget"),
+                                            tr("Warn before opening files that need more than (MiB, 0 for no budget):"),
+                                            settings.value("memory/budget_mib", 0).toInt(),
+                                            0, 1 << 24, 256, &ok);
+    if (ok)
+        settings.setValue("memory/budget_mib", budget);
+}
+
+void Viewer::update_memory_label()
+{
+    if (session.is_null()) {
+        memory_label->clear();
+        return;
+    }
+    auto m = session.memory_usage();
+    if (index)
+        m.index += index->memory_usage();
+    memory_label->setText(tr("Memory: %1").arg(MemoryDialog::format_size(m.total())));
+    memory_label->setToolTip(tr("payload %1, strings %2, index %3 (including edits, undo history and the search index)")
+                             .arg(MemoryDialog::format_size(m.payload))
+                             .arg(MemoryDialog::format_size(m.strings))
+                             .arg(MemoryDialog::format_size(m.index)));
+}
+
+void Viewer::on_actionIndexStrings_toggled(bool checked)
+{
+    QSettings().setValue("filter/trigram_index", checked);
+    if (checked) {
+        start_indexing();
+        return;
+    }
+    index.reset();
+    if (model)
+        model->set_index(nullptr);
+    update_memory_label();
+}
+
+void Viewer::start_indexing()
+{
+    if (!ui->actionIndexStrings->isChecked() || df.is_null() || index)
+        return;
+    if (index_watcher.isRunning()) {
+        // for another file, `receive_index` starts over once it is done
+        index_outdated = true;
+        return;
+    }
+
+    qDebug() << "indexing strings in the background";
+    index_outdated = false;
+    index_watcher.setFuture(QtConcurrent::run([snapshot = df]() {
+        QElapsedTimer timer;
+        timer.start();
+        try {
+            auto built = snapshot.visit([](auto& dataframe) {
+                return std::make_shared<const tfs::trigram_index>(tfs::trigram_index::build(dataframe));
+            });
+            qDebug() << "built trigram index in" << timer.elapsed() << "ms";
+            return QFilterWorker::index_t(built);
+        }
+        catch (const std::exception& e) {
+            // e.g. out of memory on a big file, searches just go without the index
+            qWarning() << "failed building the trigram index: " << e.what();
+            return QFilterWorker::index_t();
+        }
+    }));
+}
+
+void Viewer::receive_index()
+{
+    auto built = index_watcher.result();
+    if (!built) {
+        // the file that failed isn't tried again, one opened meanwhile is
+        if (index_outdated)
+            start_indexing();
+        return;
+    }
+    // another file may have been opened meanwhile
+    if (!df.is_null() && df.visit([&](auto& dataframe) { return built->covers(dataframe); })) {
+        index = built;
+        if (model)
+            model->set_index(index);
+        update_memory_label();
+    }
+    else
+        start_indexing();
+}
+
+void Viewer::set_reduced_precision(bool reduced)
+{
+    ui->actionReducedPrecision->setChecked(reduced);
+}
+
+
 void Viewer::jump_to_search()
 {
     ui->filterDataEdit->setFocus();
 }
 
+void Viewer::show_column_stats()
+{
+    auto select = ui->tableView->selectionModel();
+    if (!select || df.is_null() || select->selectedColumns().size() != 1) {
+        ui->statusbar->clearMessage();
+        return;
+    }
+
+    // computed in the background on a shared snapshot of the column, a newer selection
+    // replaces the future so stale results are never shown
+    const int column = select->selectedColumns()[0].column();
+    stats_column = df.column_name(column);
+    stats_watcher.setFuture(QtConcurrent::run([snapshot = session.snapshot(), column]() {
+        return snapshot.visit([=](auto& dataframe) { return dataframe.get_column(column).stats(); });
+    }));
+}
+
+void Viewer::receive_column_stats()
+{
+    auto stats = stats_watcher.result();
+    auto message = QString("%1: %2 values, %3 null")
+            .arg(stats_column)
+            .arg(stats.count)
+            .arg(stats.nulls);
+    if (!std::isnan(stats.mean))
+        message += QString(", min %1, max %2, mean %3").arg(stats.min).arg(stats.max).arg(stats.mean);
+    ui->statusbar->showMessage(message);
+}
+
+void Viewer::show_filter_progress(int matches, bool finished)
+{
+    filter_label->setText(finished ? tr("%1 matches").arg(matches)
+                                   : tr("filtering... %1 matches so far").arg(matches));
+}
+
 void Viewer::on_filterDataEdit_textChanged(const QString &arg1)
 {
     if (!model) return;
+    if (arg1.isEmpty())
+        filter_label->clear();
     model->filter(arg1);
 
 }
+
+void Viewer::on_filterModeBox_currentIndexChanged(int index)
+{
+    // the entries of the box are in the order of `FilterMode`
+    QSettings().setValue("filter/mode", index);
+    if (model)
+        model->set_filter_mode(static_cast<FilterMode>(index));
+}
@@ -3,9 +3,11 @@
 
 #include <QMainWindow>
 #include <QStringListModel>
-#include "tfs_dataframe.h"
+#include <QFutureWatcher>
+#include <QLabel>
+#include "anydataframe.h"
+#include "anyeditsession.h"
 #include "tfsmodel.h"
-#include "tfsdatafiltermodel.h"
 #include "tfspropertymodel.h"
 #include "qcustomplot.h"
 
@@ -23,6 +25,12 @@ public:
 
     void open_tfs(const QString& filename);
 
+    /**
+     * @brief Load files with `float` instead of `double` precision (halves the memory).
+     * Applies to files opened afterwards.
+     */
+    void set_reduced_precision(bool reduced);
+
 private slots:
     void on_actionOpen_triggered();
 
@@ -36,20 +44,79 @@ private slots:
 
     void on_actionSave_Compressed_triggered();
 
+    void on_actionExportShownRows_triggered();
+
+    void on_actionUndo_triggered();
+
+    void on_actionRedo_triggered();
+
+    void update_edit_actions();
+
+    void on_actionMemoryUsage_triggered();
+
+    void on_actionMemoryBudget_triggered();
+
+    void update_memory_label();
+
+    void on_actionIndexStrings_toggled(bool checked);
+
+    void receive_index();
+
     void jump_to_search();
 
+    void show_column_stats();
+
+    void receive_column_stats();
+
+    void show_filter_progress(int matches, bool finished);
+
     void on_filterDataEdit_textChanged(const QString &arg1);
 
+    void on_filterModeBox_currentIndexChanged(int index);
+
 private:
     Ui::Viewer *ui;
-    tfs::dataframe<double> *df;
+    // the dataframe as loaded and the edits made to it, plots and saving use `session.snapshot()`
+    AnyDataframe df;
+    AnyEditSession session;
     TFSModel *model;
     TfsPropertyModel *prop_model;
 
     QVector<QPen> plot_colors;
 
+    QFutureWatcher<tfs::column_stats> stats_watcher;
+    QString stats_column;
+
+    // permanent status bar entry with the memory taken by the open file
+    QLabel* memory_label;
+    // permanent status bar entry with the number of matches of the search
+    QLabel* filter_label;
+
+    // trigram index of the open file (nullptr if there is none yet), built in the background
+    QFilterWorker::index_t index;
+    QFutureWatcher<QFilterWorker::index_t> index_watcher;
+    // whether the index being built is for a file that has been closed since
+    bool index_outdated;
+
+    /**
+     * @brief Builds the trigram index of `df` in the background, if enabled and not there yet
+     */
+    void start_indexing();
+
+    /**
+     * @brief Asks whether to open `filename` anyway if it is estimated to need more
+     * memory than the budget set in the settings ("memory/budget_mib", 0: no budget).
+     */
+    bool fits_memory_budget(const QString& filename);
+
+    /**
+     * @brief Plots `points` against their index, skipping the rows not set in `valid`
+     * (all rows are plotted if `valid` is `nullptr`).
+     */
+    template<typename real>
     void set_chart(const std::string& name,
-                   const std::vector<double>& points);
+                   const tfs::column_storage<real>& points,
+                   const tfs::bitmap* valid = nullptr);
     void set_chart(const std::string& name,
                    const std::vector<double>& x,
                    const QVector<QVector<double>>& y);
@@ -58,9 +125,29 @@ private:
      * Please don't destroy the origin while plotting is performed!
      * @param x
      * @param y
+     * @param shown the rows to plot (those shown in the table), nullptr for all
+     */
+    template<typename real>
+    void set_chart(const tfs::data_vector<real>& x,
+                   const QVector<const tfs::data_vector<real>*>& y,
+                   const tfs::bitmap* shown = nullptr);
+
+    /**
+     * @brief The values of `column` to plot: `%le` columns as they are, the magnitudes
+     * (or phases, see `actionPlotComplexPhase`) of `%c` columns, computed into `buffer`.
+     * Returns `nullptr` for columns that can't be plotted.
      */
-    void set_chart(const tfs::data_vector<double>& x,
-                   const QVector<const tfs::data_vector<double>*>& y);
+    template<typename real>
+    const tfs::column_storage<real>* plot_values(const tfs::data_vector<real>& column,
+                                                 tfs::column_storage<real>& buffer) const;
+
+    /**
+     * @brief The legend / axis label for `column`
+     */
+    QString plot_label(const std::string& name, tfs::DataType type) const;
+
+    template<typename real>
+    void plot_columns(const tfs::dataframe<real>& dataframe, const QModelIndexList& columns);
 
     void setViewStyles();
     
@@ -0,0 +1,67 @@
+/**
+ * @file query_test.cpp
+ * @author awegsche (you@domain.com)
+ * @brief Checks the rows the queries of the search box find in `sample.tfs`.
+ *
+ * String predicates run through `QFilterWorker::match_column`, as in the viewer.
+ *
+ * Usage: `query_test <path to sample.tfs>`
+ *
+ * @version 1.0
+ * @date 2021-03-08
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "qfilterworker.h"
+#include "tfs_query.h"
+
+namespace {
+// whether `text` finds exactly `expected` in `df`
+bool check(const tfs::dataframe<double>& df, const char* text, const std::vector<size_t>& expected)
+{
+    auto match_strings = [](auto& column, const std::string& regex) {
+        return QFilterWorker::match_column(column.as_string_vector(), QString::fromStdString(regex));
+    };
+    std::vector<size_t> found;
+    try {
+        const tfs::bitmap rows = tfs::query::parse(text, df).evaluate(df, match_strings);
+        for (size_t i = 0; i < df.size(); i++)
+            if (rows[i]) found.push_back(i);
+    }
+    catch (const std::runtime_error& e) {
+        std::printf("FAIL %s: %s\n", text, e.what());
+        return false;
+    }
+    const bool ok = found == expected;
+    std::printf("%s %s:", ok ? "ok  " : "FAIL", text);
+    for (size_t i : found) std::printf(" %zu", i);
+    std::printf("\n");
+    return ok;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::printf("usage: query_test <path to sample.tfs>\n");
+        return 2;
+    }
+    const tfs::dataframe<double> df(argv[1]);
+
+    bool ok = true;
+    // cells are compared without their quotes
+    ok &= check(df, "NAME ~ ^BPM && BETX > 150", {1, 3, 7});
+    ok &= check(df, "NAME ~ B1$", {1, 3, 4, 5, 6, 7});
+    ok &= check(df, "NAME ~ BPM", {1, 3, 5, 7});
+    ok &= check(df, "NAME !~ ^BPM", {0, 2, 4, 6, 8});
+    ok &= check(df, "NAME == BPM.10L1.B1", {3});
+    ok &= check(df, "NAME == \"BPM.10L1.B1\"", {3});
+    ok &= check(df, "KEYWORD == MONITOR", {1, 3, 5, 7});
+    ok &= check(df, "KEYWORD != MONITOR && S < 100", {0, 2});
+    return ok ? 0 : 1;
+}